@@ -0,0 +1,135 @@
+#include "analysis.h"
+
+static pthread_t analyser;
+static bool is_analyser_running = false;
+static atomic_bool should_quit = false;
+
+static FFTPlan plan;
+static float window[SPECTRUM_FFT_SIZE];
+// Sum of the window, which a sine's bin is scaled by
+static float window_gain;
+// The range of bins in each band. Bands narrower than a bin take the bin
+// nearest their centre.
+static int band_first_bins[SPECTRUM_NUM_BANDS];
+static int band_last_bins[SPECTRUM_NUM_BANDS];
+static float frames[SPECTRUM_FFT_SIZE];
+static float power[SPECTRUM_FFT_SIZE/2 + 1];
+static double hold_times[SPECTRUM_NUM_BANDS];
+static float tuner_frames[TUNER_FRAMES];
+
+// Guards spectrum and tuner_reading, which are written by the analysis
+// thread only
+static pthread_mutex_t spectrum_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Spectrum spectrum;
+static TunerReading tuner_reading;
+
+static void init_spectrum_tables() {
+  window_gain = 0;
+  for (int i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+    window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / SPECTRUM_FFT_SIZE);
+    window_gain += window[i];
+  }
+  double bin_width = (double)SAMPLE_RATE / SPECTRUM_FFT_SIZE;
+  double ratio = pow((double)SPECTRUM_MAX_FREQ / SPECTRUM_MIN_FREQ, 1.0 / SPECTRUM_NUM_BANDS);
+  for (int band = 0; band < SPECTRUM_NUM_BANDS; band++) {
+    double low = SPECTRUM_MIN_FREQ * pow(ratio, band);
+    double high = low * ratio;
+    int first = ceil(low / bin_width), last = floor(high / bin_width);
+    if (first > last)
+      first = last = round(sqrt(low * high) / bin_width);
+    band_first_bins[band] = first;
+    band_last_bins[band] = min(last, SPECTRUM_FFT_SIZE/2);
+  }
+  for (int band = 0; band < SPECTRUM_NUM_BANDS; band++)
+    spectrum.levels[band] = spectrum.peaks[band] = SPECTRUM_FLOOR_DB;
+}
+
+static void update_spectrum(double now, double elapsed) {
+  if (!read_scope_frames(frames, SPECTRUM_FFT_SIZE))
+    return;
+  for (int i = 0; i < SPECTRUM_FFT_SIZE; i++)
+    frames[i] *= window[i];
+  compute_power_spectrum(&plan, frames, power);
+
+  // The output is full scale at 0.5 (see write_audio_samples())
+  float scale = 2 / (window_gain * 0.5f);
+  // Only this thread writes spectrum, so it can read it without locking
+  Spectrum updated = spectrum;
+  for (int band = 0; band < SPECTRUM_NUM_BANDS; band++) {
+    float band_power = 0;
+    for (int bin = band_first_bins[band]; bin <= band_last_bins[band]; bin++)
+      band_power = fmaxf(band_power, power[bin]);
+    float level = 20 * log10f(sqrtf(band_power) * scale + 1e-9f);
+    level = fmaxf(level, SPECTRUM_FLOOR_DB);
+    updated.levels[band] = level;
+    if (level >= updated.peaks[band]) {
+      updated.peaks[band] = level;
+      hold_times[band] = now;
+    }
+    else if (now - hold_times[band] > SPECTRUM_HOLD_SECONDS)
+      updated.peaks[band] = fmaxf(level, updated.peaks[band] - SPECTRUM_FALL_DB_PER_SECOND * elapsed);
+  }
+  pthread_mutex_lock(&spectrum_mutex);
+  spectrum = updated;
+  pthread_mutex_unlock(&spectrum_mutex);
+}
+
+static void update_tuner() {
+  TunerReading reading = {0, 0};
+  if (read_scope_frames(tuner_frames, TUNER_FRAMES)) {
+    int n = decimate_frames(tuner_frames, TUNER_FRAMES, TUNER_DECIMATION);
+    reading.freq = detect_pitch(tuner_frames, n, SAMPLE_RATE / TUNER_DECIMATION, &reading.clarity);
+    if (reading.clarity < TUNER_MIN_CLARITY)
+      reading.freq = 0;
+  }
+  pthread_mutex_lock(&spectrum_mutex);
+  tuner_reading = reading;
+  pthread_mutex_unlock(&spectrum_mutex);
+}
+
+static void *analyser_thread(void *arg) {
+  (void)arg;
+  struct timespec period = {0, ANALYSIS_PERIOD_NS};
+  struct timespec idle_period = {0, ANALYSIS_IDLE_PERIOD_NS};
+  double last = GetTime();
+  while (!atomic_load(&should_quit)) {
+    double now = GetTime();
+    update_spectrum(now, now - last);
+    update_tuner();
+    last = now;
+    // Silence still has to be analysed for a while, for the spectrum to fall
+    // back to the floor, but that is only drawn at IDLE_FPS anyway
+    nanosleep(is_output_silent() ? &idle_period : &period, NULL);
+  }
+  return NULL;
+}
+
+void init_analysis() {
+  init_fft_plan(&plan, SPECTRUM_FFT_SIZE);
+  init_spectrum_tables();
+  is_analyser_running = pthread_create(&analyser, NULL, analyser_thread, NULL) == 0;
+  if (!is_analyser_running)
+    TraceLog(LOG_WARNING, "ANALYSIS: Could not start analysis thread, the spectrum will not be shown");
+}
+
+void cleanup_analysis() {
+  if (is_analyser_running) {
+    atomic_store(&should_quit, true);
+    pthread_join(analyser, NULL);
+    is_analyser_running = false;
+  }
+  cleanup_fft_plan(&plan);
+}
+
+void get_spectrum(Spectrum *out) {
+  pthread_mutex_lock(&spectrum_mutex);
+  *out = spectrum;
+  pthread_mutex_unlock(&spectrum_mutex);
+}
+
+TunerReading get_tuner_reading() {
+  pthread_mutex_lock(&spectrum_mutex);
+  TunerReading reading = tuner_reading;
+  pthread_mutex_unlock(&spectrum_mutex);
+  return reading;
+}
@@ -0,0 +1,61 @@
+#ifndef _ANALYSIS
+#define _ANALYSIS
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include "raylib.h"
+#include "globals.h"
+#include "util.h"
+#include "fft.h"
+#include "pitch.h"
+#include "scope.h"
+#include "meter.h"
+
+// Frames the spectrum is computed over, about 85 ms with bins 11.7 Hz apart
+#define SPECTRUM_FFT_SIZE 8192
+#define SPECTRUM_NUM_BANDS 96
+#define SPECTRUM_MIN_FREQ 20
+#define SPECTRUM_MAX_FREQ 20000
+// Levels are in dB relative to a full scale sine, and shown down to this
+#define SPECTRUM_FLOOR_DB -90
+// How long the peak of each band is held before it starts falling, and how
+// fast it falls after that
+#define SPECTRUM_HOLD_SECONDS 1.0
+#define SPECTRUM_FALL_DB_PER_SECOND 20.0
+// The tuner looks at enough output for two periods of PITCH_MIN_FREQ and the
+// one frame more that detect_pitch() needs, which it brings down to half the
+// rate before looking for the pitch
+#define TUNER_FRAMES (2 * SAMPLE_RATE / PITCH_MIN_FREQ + TUNER_DECIMATION)
+#define TUNER_DECIMATION 2
+// Readings that are less periodic than this are thrown away
+#define TUNER_MIN_CLARITY 0.8
+// The analysis thread runs about once per displayed frame, and at IDLE_FPS
+// while the output is silent
+#define ANALYSIS_PERIOD_NS (1000000000 / FPS)
+#define ANALYSIS_IDLE_PERIOD_NS (1000000000 / IDLE_FPS)
+
+/* A helper thread analyses the latest output from the scope tap (see
+ * scope.h), so that neither the audio callback nor the GUI thread spends any
+ * time on it. The GUI copies out the latest results whenever it draws them. */
+
+typedef struct {
+  // Levels of log spaced bands from SPECTRUM_MIN_FREQ to SPECTRUM_MAX_FREQ
+  float levels[SPECTRUM_NUM_BANDS];
+  float peaks[SPECTRUM_NUM_BANDS];
+} Spectrum;
+
+typedef struct {
+  float freq;  // In Hz, or 0 if the output has no clear pitch
+  float clarity;  // See detect_pitch()
+} TunerReading;
+
+/* Called from the main thread, after InitAudioDevice() */
+void init_analysis();
+void cleanup_analysis();
+void get_spectrum(Spectrum *spectrum);
+TunerReading get_tuner_reading();
+
+#endif
@@ -0,0 +1,125 @@
+#include "bank.h"
+#include "sample.h"
+
+static MappedFile *banks;
+
+static bool is_bank_valid(const MappedFile *file) {
+  if (file->size < sizeof(BankHeader))
+    return false;
+  const BankHeader *header = (const BankHeader *)file->bytes;
+  if (memcmp(header->magic, BANK_MAGIC, 8) != 0 || header->version != BANK_VERSION)
+    return false;
+  size_t tables_size = sizeof(BankHeader)
+    + (size_t)header->num_instruments * sizeof(BankInstrument)
+    + (size_t)header->num_pcms * sizeof(BankPcm)
+    + (size_t)header->num_samples * sizeof(BankSample);
+  if (tables_size > file->size)
+    return false;
+
+  const BankInstrument *instruments = (const BankInstrument *)(header + 1);
+  const BankPcm *pcms = (const BankPcm *)(instruments + header->num_instruments);
+  const BankSample *samples = (const BankSample *)(pcms + header->num_pcms);
+  for (uint32_t i = 0; i < header->num_instruments; i++) {
+    const BankInstrument *instrument = &instruments[i];
+    if ((instrument->type != SAMPLE && instrument->type != MULTISAMPLE)
+	|| instrument->first_sample > header->num_samples
+	|| instrument->num_samples > header->num_samples - instrument->first_sample
+	|| memchr(instrument->name, '\0', MAX_STR_LEN) == NULL)
+      return false;
+  }
+  for (uint32_t i = 0; i < header->num_pcms; i++) {
+    const BankPcm *pcm = &pcms[i];
+    int frame_size = pcm->format == PCM_S16 ? 2 : pcm->format == PCM_S24 ? 3 : 4;
+    if ((pcm->format != PCM_S16 && pcm->format != PCM_S24 && pcm->format != PCM_F32)
+	|| pcm->num_frames < 2 || pcm->num_frames > INT32_MAX || pcm->sample_rate == 0
+	|| pcm->offset % BANK_ALIGNMENT != 0 || pcm->offset > file->size
+	|| (uint64_t)pcm->num_frames * frame_size > file->size - pcm->offset
+	|| memchr(pcm->name, '\0', MAX_STR_LEN) == NULL)
+      return false;
+  }
+  for (uint32_t i = 0; i < header->num_samples; i++) {
+    if (samples[i].pcm >= header->num_pcms || samples[i].note >= NOTETABLE_SIZE)
+      return false;
+  }
+  return true;
+}
+
+bool load_sample_bank(const char *path) {
+  // Leaves room for the index in the keys of the pinned samples
+  char canonical_path[MAX_PATH_LEN - 16];
+  MappedFile file;
+  if (!get_canonical_path(path, canonical_path, sizeof(canonical_path)) || !map_file(canonical_path, &file)) {
+    TraceLog(LOG_WARNING, "BANK: Could not open %s", path);
+    return false;
+  }
+  if (!is_bank_valid(&file)) {
+    TraceLog(LOG_WARNING, "BANK: %s is not a sample bank that can be read", path);
+    unmap_file(&file);
+    return false;
+  }
+  arrput(banks, file);
+
+  const BankHeader *header = (const BankHeader *)file.bytes;
+  const BankInstrument *bank_instruments = (const BankInstrument *)(header + 1);
+  const BankPcm *pcms = (const BankPcm *)(bank_instruments + header->num_instruments);
+  const BankSample *bank_samples = (const BankSample *)(pcms + header->num_pcms);
+
+  // The only fix-ups needed are from offsets to pointers into the mapping
+  for (uint32_t i = 0; i < header->num_pcms; i++) {
+    char key[MAX_PATH_LEN];
+    snprintf(key, MAX_PATH_LEN, "%s#%u", canonical_path, i);
+    add_pinned_sample(pcms[i].name, key, pcms[i].sample_rate, pcms[i].num_frames,
+		      pcms[i].format, file.bytes + pcms[i].offset);
+  }
+
+  for (uint32_t i = 0; i < header->num_instruments; i++) {
+    const BankInstrument *bank_instrument = &bank_instruments[i];
+    add_instrument();
+    int instrument_num = get_num_instruments() - 1;
+    Instrument *instrument = &get_instruments()[instrument_num];
+    InstrumentInfo *info = &get_instrument_infos()[instrument_num];
+    strcpy(info->name, bank_instrument->name);
+    instrument->type = bank_instrument->type;
+
+    for (uint32_t j = 0; j < bank_instrument->num_samples; j++) {
+      const BankSample *bank_sample = &bank_samples[bank_instrument->first_sample + j];
+      // A sample instrument only has its first sample
+      int note = instrument->type == SAMPLE ? 0 : (int)bank_sample->note;
+      Sample *sample = &instrument->samples[note];
+      SampleInfo *sample_info = &info->samples[note];
+      if (sample->is_ready)
+	unload_sample_data(sample, sample_info);
+      sample->pitch_modifier = bank_sample->pitch_modifier;
+      sample->volume_modifier = bank_sample->volume_modifier;
+      sample->play_continuously = bank_sample->play_continuously;
+      sample->stop_on_release = bank_sample->stop_on_release;
+      sample->adsr.attack_frames = bank_sample->attack_frames;
+      sample->adsr.decay_frames = bank_sample->decay_frames;
+      sample->adsr.sustain_vol = bank_sample->sustain_vol;
+      sample->adsr.release_frames = bank_sample->release_frames;
+      strcpy(sample_info->path, pcms[bank_sample->pcm].name);
+      sample->is_ready = load_sample_data(get_sample_file_path(sample_info->path), sample, sample_info);
+      // Only multisample instruments take the envelope from their samples (see
+      // apply_adsr())
+      if (instrument->type == SAMPLE)
+	instrument->adsr = sample->adsr;
+    }
+
+    if (instrument->type == SAMPLE && instrument->samples[0].is_ready) {
+      for (int note = 1; note < NOTETABLE_SIZE; note++) {
+	// Every note shares the data of the first
+	instrument->samples[note] = instrument->samples[0];
+	info->samples[note] = info->samples[0];
+	retain_sample_data(&info->samples[note]);
+      }
+    }
+  }
+  return true;
+}
+
+void cleanup_sample_banks() {
+  remove_pinned_samples();
+  for (int i = 0; i < (int)arrlenu(banks); i++)
+    unmap_file(&banks[i]);
+  arrfree(banks);
+}
@@ -0,0 +1,83 @@
+#ifndef _BANK
+#define _BANK
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "raylib.h"
+#include "stb_ds.h"
+#include "note.h"
+#include "instrument.h"
+#include "wav.h"
+
+/* A sample bank holds a set of sample instruments along with the PCM data of
+ * all their samples, laid out so that it can be used straight from a memory
+ * mapping. Banks are made from a text manifest by vibro-pack (pack.c), and
+ * loaded with vibro --bank.
+ *
+ * The file starts with a BankHeader, followed by num_instruments
+ * BankInstruments, num_pcms BankPcms and num_samples BankSamples. The PCM data
+ * follows, each at a multiple of BANK_ALIGNMENT from the start of the file, so
+ * that it is page aligned in the mapping and only read in from disk once a
+ * voice first plays it. Everything is little-endian. The tables are read in
+ * place, so each record is a multiple of 8 bytes long, which keeps every
+ * table (and the 64-bit fields in it) 8-byte aligned. */
+
+#define BANK_MAGIC "VIBROBNK"
+#define BANK_VERSION 1
+#define BANK_ALIGNMENT 4096
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_instruments;
+  uint32_t num_pcms;
+  uint32_t num_samples;
+} BankHeader;
+
+typedef struct {
+  char name[MAX_STR_LEN];
+  uint32_t type;  // SAMPLE or MULTISAMPLE
+  // The instrument's samples are num_samples BankSamples from first_sample
+  uint32_t first_sample;
+  uint32_t num_samples;
+} BankInstrument;
+
+/** The PCM data of one sample file, shared by every sample that uses it **/
+typedef struct {
+  // The path of the file relative to the manifest, which is used as the
+  // sample's path in instrument mode
+  char name[MAX_STR_LEN];
+  uint32_t sample_rate;
+  uint32_t format;  // PCM_S16, PCM_S24 or PCM_F32, mono
+  uint32_t num_frames;
+  uint64_t offset;
+} BankPcm;
+
+/** A sample as mapped to a note of an instrument **/
+typedef struct {
+  uint32_t pcm;  // Index into the BankPcms
+  uint32_t note;
+  float pitch_modifier;
+  float volume_modifier;
+  uint8_t play_continuously;
+  uint8_t stop_on_release;
+  int32_t attack_frames;
+  int32_t decay_frames;
+  float sustain_vol;
+  int32_t release_frames;
+} BankSample;
+
+// The PCM table's offset depends on MAX_STR_LEN through BankInstrument, so a
+// change to either would otherwise silently misalign it
+_Static_assert(sizeof(BankHeader) % 8 == 0, "BankHeader must keep the tables aligned");
+_Static_assert(sizeof(BankInstrument) % 8 == 0, "BankInstrument must keep the tables aligned");
+_Static_assert(sizeof(BankPcm) % 8 == 0, "BankPcm must keep the tables aligned");
+
+/* Map the bank at path and add its instruments. The bank stays mapped until
+   cleanup_sample_banks(). Returns false if it can't be loaded. */
+bool load_sample_bank(const char *path);
+/* To be called after every sample has been unloaded */
+void cleanup_sample_banks();
+
+#endif
@@ -0,0 +1,163 @@
+#include "fft.h"
+
+bool init_fft_plan(FFTPlan *plan, int size) {
+  if (size < 8 || (size & (size - 1)) != 0)
+    return false;
+  plan->size = size;
+  int n = size / 2;  // Of the complex FFT
+  plan->num_stages = 0;
+  for (int m = n; m > 1; ) {
+    int radix = m % 4 == 0 ? 4 : 2;
+    int stage = plan->num_stages++;
+    plan->radices[stage] = radix;
+    // Stage with sub-length m uses w = exp(-2 pi i / m)
+    int num_twiddles = m / radix;
+    plan->twiddle_re[stage] = malloc((radix - 1) * num_twiddles * sizeof(float));
+    plan->twiddle_im[stage] = malloc((radix - 1) * num_twiddles * sizeof(float));
+    for (int k = 1; k < radix; k++) {
+      for (int p = 0; p < num_twiddles; p++) {
+	double angle = -2 * M_PI * k * p / m;
+	plan->twiddle_re[stage][(k-1) * num_twiddles + p] = cos(angle);
+	plan->twiddle_im[stage][(k-1) * num_twiddles + p] = sin(angle);
+      }
+    }
+    m /= radix;
+  }
+
+  plan->split_re = malloc((n + 1) * sizeof(float));
+  plan->split_im = malloc((n + 1) * sizeof(float));
+  for (int k = 0; k <= n; k++) {
+    double angle = -2 * M_PI * k / size;
+    plan->split_re[k] = cos(angle);
+    plan->split_im[k] = sin(angle);
+  }
+  plan->re = malloc(n * sizeof(float));
+  plan->im = malloc(n * sizeof(float));
+  plan->work_re = malloc(n * sizeof(float));
+  plan->work_im = malloc(n * sizeof(float));
+  return true;
+}
+
+void cleanup_fft_plan(FFTPlan *plan) {
+  for (int stage = 0; stage < plan->num_stages; stage++) {
+    free(plan->twiddle_re[stage]);
+    free(plan->twiddle_im[stage]);
+  }
+  free(plan->split_re);
+  free(plan->split_im);
+  free(plan->re);
+  free(plan->im);
+  free(plan->work_re);
+  free(plan->work_im);
+  plan->num_stages = 0;
+}
+
+// One radix 4 stage, from x to y. Sub-length m, stride s.
+static void radix4_stage(int m, int s, const float *w_re, const float *w_im,
+			 const float *x_re, const float *x_im, float *y_re, float *y_im) {
+  int quarter = m / 4;
+  for (int p = 0; p < quarter; p++) {
+    float w1r = w_re[p], w1i = w_im[p];
+    float w2r = w_re[quarter + p], w2i = w_im[quarter + p];
+    float w3r = w_re[2*quarter + p], w3i = w_im[2*quarter + p];
+    const int a = s*p, b = s*(p + quarter), c = s*(p + 2*quarter), d = s*(p + 3*quarter);
+    const int y0 = s*4*p, y1 = s*(4*p + 1), y2 = s*(4*p + 2), y3 = s*(4*p + 3);
+    int q = 0;
+#ifdef __SSE2__
+    const __m128 v1r = _mm_set1_ps(w1r), v1i = _mm_set1_ps(w1i);
+    const __m128 v2r = _mm_set1_ps(w2r), v2i = _mm_set1_ps(w2i);
+    const __m128 v3r = _mm_set1_ps(w3r), v3i = _mm_set1_ps(w3i);
+    for (; q + 4 <= s; q += 4) {
+      __m128 ar = _mm_loadu_ps(x_re + a + q), ai = _mm_loadu_ps(x_im + a + q);
+      __m128 br = _mm_loadu_ps(x_re + b + q), bi = _mm_loadu_ps(x_im + b + q);
+      __m128 cr = _mm_loadu_ps(x_re + c + q), ci = _mm_loadu_ps(x_im + c + q);
+      __m128 dr = _mm_loadu_ps(x_re + d + q), di = _mm_loadu_ps(x_im + d + q);
+      __m128 apcr = _mm_add_ps(ar, cr), apci = _mm_add_ps(ai, ci);
+      __m128 amcr = _mm_sub_ps(ar, cr), amci = _mm_sub_ps(ai, ci);
+      __m128 bpdr = _mm_add_ps(br, dr), bpdi = _mm_add_ps(bi, di);
+      // j(b - d)
+      __m128 jbmdr = _mm_sub_ps(di, bi), jbmdi = _mm_sub_ps(br, dr);
+      _mm_storeu_ps(y_re + y0 + q, _mm_add_ps(apcr, bpdr));
+      _mm_storeu_ps(y_im + y0 + q, _mm_add_ps(apci, bpdi));
+      __m128 tr = _mm_sub_ps(amcr, jbmdr), ti = _mm_sub_ps(amci, jbmdi);
+      _mm_storeu_ps(y_re + y1 + q, _mm_sub_ps(_mm_mul_ps(tr, v1r), _mm_mul_ps(ti, v1i)));
+      _mm_storeu_ps(y_im + y1 + q, _mm_add_ps(_mm_mul_ps(tr, v1i), _mm_mul_ps(ti, v1r)));
+      tr = _mm_sub_ps(apcr, bpdr); ti = _mm_sub_ps(apci, bpdi);
+      _mm_storeu_ps(y_re + y2 + q, _mm_sub_ps(_mm_mul_ps(tr, v2r), _mm_mul_ps(ti, v2i)));
+      _mm_storeu_ps(y_im + y2 + q, _mm_add_ps(_mm_mul_ps(tr, v2i), _mm_mul_ps(ti, v2r)));
+      tr = _mm_add_ps(amcr, jbmdr); ti = _mm_add_ps(amci, jbmdi);
+      _mm_storeu_ps(y_re + y3 + q, _mm_sub_ps(_mm_mul_ps(tr, v3r), _mm_mul_ps(ti, v3i)));
+      _mm_storeu_ps(y_im + y3 + q, _mm_add_ps(_mm_mul_ps(tr, v3i), _mm_mul_ps(ti, v3r)));
+    }
+#endif
+    for (; q < s; q++) {
+      float apcr = x_re[a+q] + x_re[c+q], apci = x_im[a+q] + x_im[c+q];
+      float amcr = x_re[a+q] - x_re[c+q], amci = x_im[a+q] - x_im[c+q];
+      float bpdr = x_re[b+q] + x_re[d+q], bpdi = x_im[b+q] + x_im[d+q];
+      float jbmdr = x_im[d+q] - x_im[b+q], jbmdi = x_re[b+q] - x_re[d+q];
+      y_re[y0+q] = apcr + bpdr;
+      y_im[y0+q] = apci + bpdi;
+      float tr = amcr - jbmdr, ti = amci - jbmdi;
+      y_re[y1+q] = tr*w1r - ti*w1i;
+      y_im[y1+q] = tr*w1i + ti*w1r;
+      tr = apcr - bpdr; ti = apci - bpdi;
+      y_re[y2+q] = tr*w2r - ti*w2i;
+      y_im[y2+q] = tr*w2i + ti*w2r;
+      tr = amcr + jbmdr; ti = amci + jbmdi;
+      y_re[y3+q] = tr*w3r - ti*w3i;
+      y_im[y3+q] = tr*w3i + ti*w3r;
+    }
+  }
+}
+
+static void radix2_stage(int m, int s, const float *w_re, const float *w_im,
+			 const float *x_re, const float *x_im, float *y_re, float *y_im) {
+  int half = m / 2;
+  for (int p = 0; p < half; p++) {
+    float wr = w_re[p], wi = w_im[p];
+    const int a = s*p, b = s*(p + half), y0 = s*2*p, y1 = s*(2*p + 1);
+    for (int q = 0; q < s; q++) {
+      float tr = x_re[a+q] - x_re[b+q], ti = x_im[a+q] - x_im[b+q];
+      y_re[y0+q] = x_re[a+q] + x_re[b+q];
+      y_im[y0+q] = x_im[a+q] + x_im[b+q];
+      y_re[y1+q] = tr*wr - ti*wi;
+      y_im[y1+q] = tr*wi + ti*wr;
+    }
+  }
+}
+
+void compute_power_spectrum(FFTPlan *plan, const float *frames, float *power) {
+  int n = plan->size / 2;
+  // Even frames go in the real part and odd ones in the imaginary part
+  float *x_re = plan->re, *x_im = plan->im, *y_re = plan->work_re, *y_im = plan->work_im;
+  for (int i = 0; i < n; i++) {
+    x_re[i] = frames[2*i];
+    x_im[i] = frames[2*i + 1];
+  }
+
+  int m = n, s = 1;
+  for (int stage = 0; stage < plan->num_stages; stage++) {
+    if (plan->radices[stage] == 4)
+      radix4_stage(m, s, plan->twiddle_re[stage], plan->twiddle_im[stage], x_re, x_im, y_re, y_im);
+    else
+      radix2_stage(m, s, plan->twiddle_re[stage], plan->twiddle_im[stage], x_re, x_im, y_re, y_im);
+    m /= plan->radices[stage];
+    s *= plan->radices[stage];
+    float *t = x_re; x_re = y_re; y_re = t;
+    t = x_im; x_im = y_im; y_im = t;
+  }
+
+  // X_k = (Z_k + conj(Z_{n-k}))/2 - i w^k (Z_k - conj(Z_{n-k}))/2, w = exp(-2 pi i / size)
+  for (int k = 0; k <= n; k++) {
+    float zr = x_re[k % n], zi = x_im[k % n];
+    float cr = x_re[(n - k) % n], ci = -x_im[(n - k) % n];
+    float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+    float or_ = 0.5f * (zr - cr), oi = 0.5f * (zi - ci);
+    // -i (o) = (oi, -or)
+    float tr = oi, ti = -or_;
+    float wr = plan->split_re[k], wi = plan->split_im[k];
+    float xr = er + tr*wr - ti*wi;
+    float xi = ei + tr*wi + ti*wr;
+    power[k] = xr*xr + xi*xi;
+  }
+}
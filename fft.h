@@ -0,0 +1,38 @@
+#ifndef _FFT
+#define _FFT
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MAX_FFT_STAGES 16
+
+/* A real FFT of one size, with everything that doesn't depend on the input
+ * worked out in advance. The complex FFT underneath is a Stockham autosort
+ * FFT, of radix 4 with a final radix 2 stage when needed, on split real and
+ * imaginary arrays. Its butterflies are vectorised with SSE2 where available,
+ * across the runs of 4 or more that every stage after the first has. */
+typedef struct {
+  int size;  // Of the real input; a power of two, at least 8
+  int num_stages;
+  int radices[MAX_FFT_STAGES];
+  // Twiddles of each stage, w^p for p < m, then w^2p, then w^3p for radix 4
+  float *twiddle_re[MAX_FFT_STAGES];
+  float *twiddle_im[MAX_FFT_STAGES];
+  // For splitting the half size complex FFT into the real one
+  float *split_re;
+  float *split_im;
+  // Working space
+  float *re, *im, *work_re, *work_im;
+} FFTPlan;
+
+bool init_fft_plan(FFTPlan *plan, int size);
+void cleanup_fft_plan(FFTPlan *plan);
+/* Power spectrum of size real frames, |X_k|^2 for k = 0 to size/2, into
+   power (which must hold size/2 + 1 values) */
+void compute_power_spectrum(FFTPlan *plan, const float *frames, float *power);
+
+#endif
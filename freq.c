@@ -3,6 +3,9 @@
 #define MAX_DIVE_FRAMES (FPS / 2)
 #define DIVE_FREQ_STEP 0.95
 #define GLISS_FREQ_STEP 1.0194
+// Bounds on the duration of an autogliss
+#define MIN_AUTOGLISS_MS 80
+#define MAX_AUTOGLISS_MS 1600
 
 // Pitch bends are controlled via mousewheel scrolling.
 static float bend_modifier = 1;
@@ -10,29 +13,47 @@ static float bend_modifier = 1;
 static float gliss_modifier = 1;
 // Vibrato is controlled by SPACE key.
 static float vib_modifier = 1;
+// The audio thread runs its own sample-rate vibrato LFO from these, rather than
+// stepping through vib_modifier once per frame.
+static float vib_rate = 0;       // In Hz
+static float vib_log_depth = 0;  // Log of the maximum frequency ratio
 // Dive effect is activated by ALT key.
 static float dive_modifier = 1;
 
 // Autogliss is activated when the user glisses while pressing a new note, and
 // without releasing the previous note. The speed of the vertical mouse movement
-// (measured in prev_mouse_dy) determines the number of frames to autogliss
-// (stored in autogliss_total_frames). At each frame, the frequency is scaled by
-// a factor of autogliss_freq_step, starting from autogliss_start_freq (i.e. the
-// actual frequency right before new note was pressed); autogliss_frame_counter
-// is also incremented.
+// (measured in prev_mouse_dy) determines how long to autogliss for (stored in
+// autogliss_ms). The frequency moves exponentially from autogliss_start_freq
+// (i.e. the actual frequency right before new note was pressed) to
+// autogliss_target_freq.
+// The audio thread does the actual gliss sample by sample (see
+// get_new_autogliss()); the timing here is only used to decide when autogliss
+// is over, and to estimate its frequency for the GUI and samples.
 
 static int prev_mouse_dy = 0;
-static int autogliss_total_frames = 0;
-static int autogliss_frame_counter = 0;
-static float autogliss_freq_step = 1;
+static float autogliss_ms = 0;
+static double autogliss_start_time = 0;
 static float autogliss_start_freq;
+static float autogliss_target_freq;
+
+// The most recent autogliss, handed to the audio thread. seq is odd while
+// the fields are being written. The fields are atomics too, so that reading
+// them during a write is only a torn copy to be retried, not a data race.
+static atomic_int last_autogliss_from_note;
+static atomic_int last_autogliss_to_note;
+static atomic_int last_autogliss_num_frames;
+static atomic_uint last_autogliss_seq = 0;
 
 float get_note_freq(int note, int octave) {
-  return C4 * pow(2, octave) * pow(SEMITONE, note);
+  return get_tuned_freq(note, octave);
+}
+
+float get_base_freq(int note, int octave) {
+  return get_note_freq(note, octave) * bend_modifier * gliss_modifier * dive_modifier;
 }
 
 float get_actual_freq(int note, int octave) {
-  return get_note_freq(note, octave) * bend_modifier * gliss_modifier * vib_modifier * dive_modifier;
+  return get_base_freq(note, octave) * vib_modifier;
 }
 
 void update_pitch_bend() {
@@ -61,9 +82,17 @@ void update_pitch_bend() {
   }
 }
 
+static float get_autogliss_progress() {
+  return fclamp((GetTime() - autogliss_start_time) * 1000 / autogliss_ms, 0, 1);
+}
+
+static float get_autogliss_freq() {
+  return autogliss_start_freq * powf(autogliss_target_freq / autogliss_start_freq, get_autogliss_progress());
+}
+
 bool is_autoglissing() {
   NoteState s = get_cur_note_state();
-  return is_solo_mode() && autogliss_frame_counter < autogliss_total_frames && (s == PRESSED || s == HELD);
+  return is_solo_mode() && autogliss_ms > 0 && get_autogliss_progress() < 1 && (s == PRESSED || s == HELD);
 }
 
 void update_gliss() {
@@ -111,12 +140,13 @@ void update_vib() {
   // frames_space_down and controls vibrato depth (vib_depth).
 
   // The actual vibrato works by oscillating the frequency according to a sine
-  // wave. The current phase of the wave is stored in vib_phase.
+  // wave. The current phase of the wave is stored in vib_phase. vib_depth is
+  // kept as a logarithm (vib_log_depth) so that it can decay smoothly and be
+  // handed to the audio thread as is.
 
   static int frames_space_down = 0;
   static int frames_space_up = 0;
   static float vib_speed = 0;
-  static float vib_depth = 1;
   static float vib_phase = 0;
 
   static bool space_down;
@@ -124,7 +154,7 @@ void update_vib() {
 
   // Momentarily kill vibrato when a new note is pressed.
   if (is_any_note_pressed()) {
-    vib_depth = 1;
+    vib_log_depth = 0;
     vib_modifier = 1;
     frames_space_down = 0;
     frames_space_up = 1;
@@ -150,7 +180,7 @@ void update_vib() {
     // SPACE was just released, now we compute vibrato depth based on
     // how long SPACE was pressed
     if (prev_space_down) {
-      vib_depth = fclamp(pow(1.003, frames_space_down), 1, 1.04);
+      vib_log_depth = logf(fclamp(pow(1.003, frames_space_down), 1, 1.04));
       frames_space_down = 0;
     }
     // Continue keeping track of how long SPACE isn't pressed
@@ -159,8 +189,9 @@ void update_vib() {
       // Make vibrato decay if SPACE is not pressed for a long while
       if (frames_space_up > 30) {
 	vib_speed = 0;
-	vib_phase = 0;
-	vib_modifier += 0.2 * (1.0 - vib_modifier);
+	vib_rate = 0;
+	vib_log_depth *= 0.8;
+	vib_modifier = expf(vib_log_depth * sinf(vib_phase * 2 * PI));
 	return;
       }
     }
@@ -169,7 +200,35 @@ void update_vib() {
   vib_phase += vib_speed / 2;
   if (vib_phase >= 1)
     vib_phase -= 1;
-  vib_modifier = pow(vib_depth, sinf(vib_phase * 2 * PI));
+  vib_rate = vib_speed / 2 * FPS;
+  vib_modifier = expf(vib_log_depth * sinf(vib_phase * 2 * PI));
+}
+
+static void publish_autogliss(int from_note, int to_note) {
+  unsigned seq = atomic_load_explicit(&last_autogliss_seq, memory_order_relaxed);
+  atomic_store_explicit(&last_autogliss_seq, seq + 1, memory_order_relaxed);
+  // Keeps the fields from being written before seq is seen to be odd
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&last_autogliss_from_note, from_note, memory_order_relaxed);
+  atomic_store_explicit(&last_autogliss_to_note, to_note, memory_order_relaxed);
+  atomic_store_explicit(&last_autogliss_num_frames, autogliss_ms * SAMPLE_RATE / 1000, memory_order_relaxed);
+  atomic_store_explicit(&last_autogliss_seq, seq + 2, memory_order_release);
+}
+
+bool get_new_autogliss(unsigned *seq, Autogliss *autogliss) {
+  unsigned seq_before = atomic_load_explicit(&last_autogliss_seq, memory_order_acquire);
+  if (seq_before == *seq || seq_before % 2 == 1)
+    return false;
+  autogliss->from_note = atomic_load_explicit(&last_autogliss_from_note, memory_order_relaxed);
+  autogliss->to_note = atomic_load_explicit(&last_autogliss_to_note, memory_order_relaxed);
+  autogliss->num_frames = atomic_load_explicit(&last_autogliss_num_frames, memory_order_relaxed);
+  // Keeps the fields from being read after seq is checked again. Try again
+  // next time if they were overwritten in the meantime.
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&last_autogliss_seq, memory_order_relaxed) != seq_before)
+    return false;
+  *seq = seq_before;
+  return true;
 }
 
 void update_autogliss() {
@@ -180,51 +239,54 @@ void update_autogliss() {
     no_attack(); // We don't want to attack the new note!
     float cur_note_freq = get_note_freq(get_cur_note() - 1, get_cur_actual_octave());
     if (is_autoglissing()) // If currently autoglissing, we continue the autogliss from the current frequency and move to the new target
-      autogliss_start_freq = autogliss_start_freq * powf(autogliss_freq_step, autogliss_frame_counter);
+      autogliss_start_freq = get_autogliss_freq();
     else {
       autogliss_start_freq = get_actual_freq(get_prev_note() - 1, get_prev_actual_octave());
       gliss_modifier = 1; // Reset gliss; moving mouse vertically now does nothing until autogliss is complete
-      autogliss_total_frames = fabs(cur_note_freq - autogliss_start_freq) / powf(abs(prev_mouse_dy), 0.6);
-      autogliss_total_frames = fclamp(autogliss_total_frames, 5, 100);
+      autogliss_ms = 1000.0 / FPS * fabs(cur_note_freq - autogliss_start_freq) / powf(abs(prev_mouse_dy), 0.6);
+      autogliss_ms = fclamp(autogliss_ms, MIN_AUTOGLISS_MS, MAX_AUTOGLISS_MS);
     }
-    autogliss_freq_step = powf(cur_note_freq / autogliss_start_freq, 1.0 / autogliss_total_frames);
-    autogliss_frame_counter = 0;
+    autogliss_target_freq = cur_note_freq;
+    autogliss_start_time = GetTime();
+    publish_autogliss(get_prev_note(), get_cur_note());
   }
 
-  if (is_autoglissing())
-    autogliss_frame_counter++;
-  else {
-    autogliss_frame_counter = 0;
-    autogliss_total_frames = 0;
-    autogliss_freq_step = 1;
+  if (!is_autoglissing())
+    autogliss_ms = 0;
+}
+
+void get_cur_base_freqs(float *freqs) {
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    if (voices.note_states[note] == STILLRELEASED)
+      freqs[note] = get_base_freq(note-1, voices.octaves_on_release[note]);
+    else
+      freqs[note] = get_base_freq(note-1, get_cur_actual_octave());
   }
 }
 
 float *get_cur_actual_freqs() {
   static float freqs[NOTETABLE_SIZE];
-  if (is_solo_mode() && is_any_note_playing() && is_autoglissing()) {
-    freqs[get_cur_note()] = autogliss_start_freq * powf(autogliss_freq_step, autogliss_frame_counter) * vib_modifier;
-  }
-  else {
-    for (int note = 0; note < NOTETABLE_SIZE; note++) {
-      if (get_cur_note_states()[note] == STILLRELEASED)
-	freqs[note] = get_actual_freq(note-1, get_octaves_on_release()[note]);
-      else
-	freqs[note] = get_actual_freq(note-1, get_cur_actual_octave());
-    }
-  }
+  get_cur_base_freqs(freqs);
+  if (is_solo_mode() && is_any_note_playing() && is_autoglissing())
+    freqs[get_cur_note()] = get_autogliss_freq();
+  for (int note = 0; note < NOTETABLE_SIZE; note++)
+    freqs[note] *= vib_modifier;
   return freqs;
 }
 
 float get_bend_modifier() { return bend_modifier; }
 float get_gliss_modifier() { return gliss_modifier; }
 float get_vib_modifier() { return vib_modifier; }
+float get_vib_rate() { return vib_rate; }
+float get_vib_log_depth() { return vib_log_depth; }
 float get_dive_modifier() { return dive_modifier; }
-float get_autogliss_modifier() { return powf(autogliss_freq_step, autogliss_frame_counter); }
+float get_autogliss_modifier() { return is_autoglissing() ? get_autogliss_freq() / autogliss_target_freq : 1; }
 
 void reset_freq_modifiers() {
   bend_modifier = 1;
   gliss_modifier = 1;
   vib_modifier = 1;
+  vib_rate = 0;
+  vib_log_depth = 0;
   dive_modifier = 1;
 }
\ No newline at end of file
@@ -1,18 +1,33 @@
 #ifndef FREQ
 #define FREQ
 
+#include <stdatomic.h>
 #include "raylib.h"
 #include "note.h"
 #include "util.h"
+#include "tuning.h"
 
-#define SEMITONE 1.05946 // Moving up a semitone scales the frequency by this factor
-#define C4 261.6 // In Hz
+#define SEMITONE 1.0594630943592953 // Moving up a semitone scales the frequency by this factor
 
 // Pitch modifiers refer to the following expressive controls:
 // pitch bend, gliss, dive, vibrato, autogliss;
 // which can alter the pitch of the currently played note.
 
-float get_note_freq(int note, int octave); /* Get frequency of note at octave, without any pitch modifiers. */
+/* An autogliss, as carried out by the audio thread: to_note starts from
+   whatever pitch from_note is at, and glides exponentially to its own pitch
+   over num_frames audio frames. */
+typedef struct {
+  int from_note;
+  int to_note;
+  int num_frames;
+} Autogliss;
+
+/* Get frequency of note at octave, without any pitch modifiers.
+   This is a lookup into the table kept by tuning.c. */
+float get_note_freq(int note, int octave);
+/* Get frequency of note at octave, with every pitch modifier except vibrato
+   and autogliss. */
+float get_base_freq(int note, int octave);
  /* Get frequency of note at octave, with pitch modifiers.
     NOTE: this does not account for autogliss. */
 float get_actual_freq(int note, int octave);
@@ -22,14 +37,25 @@ void update_gliss();
 void update_dive();
 void update_vib();
 void update_autogliss();
+/* (AUDIO THREAD)
+   If there has been an autogliss since the one numbered *seq, copy it into
+   autogliss, update *seq and return true. */
+bool get_new_autogliss(unsigned *seq, Autogliss *autogliss);
 /* Returns a table of frequencies for each note in the notetable, accounting for pitch modifiers.
-   Unlike get_actual_freq(), this accounts for autogliss.
+   Unlike get_actual_freq(), this accounts for autogliss (as estimated on the GUI thread).
    NOTE: ths can be used in solo mode, but you should only trust the entry given by get_cur_note(). */
 float *get_cur_actual_freqs();
+/* Like get_cur_actual_freqs(), but without vibrato and autogliss, and writing
+   into the caller's table. This is what the audio thread ramps towards across each
+   block; vibrato is added there by its own LFO (see get_vib_rate()). */
+void get_cur_base_freqs(float *freqs);
 float get_bend_modifier();
 float get_gliss_modifier();
 float get_vib_modifier();
+float get_vib_rate(); /* In Hz */
+float get_vib_log_depth(); /* Log of the maximum frequency ratio of the vibrato */
 float get_dive_modifier();
+/* Ratio of the current autogliss frequency to the note being glissed to */
 float get_autogliss_modifier();
 void reset_freq_modifiers();
 
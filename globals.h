@@ -4,6 +4,11 @@
 #include "tinywav/tinywav.h"
 
 #define FPS 60
+// When nothing is sounding and there is no input, the screen is only drawn at
+// this rate, and the helper threads wake up no more often. Input and
+// control-rate updates still run at FPS. FPS must be a multiple of it (see the
+// main loop).
+#define IDLE_FPS 10
 
 // Parameters passed to the Raylib audio functions
 // SetAudioStreamBufferSizeDefault() and LoadAudioStream()
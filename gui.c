@@ -1,29 +1,186 @@
 #include "gui.h"
 
-void DrawShadowedText(const char *text, int x, int y, int font_size, Color color) {
+typedef struct {
+  uint64_t hash;
+  char *text;
+  int font_size;
+  Color color;
+  Vector2 size;  // As measured with no spacing, which is what text is aligned by
+  int width;  // As given by MeasureText()
+  int num_uses;
+  double last_used;  // In seconds, as given by GetTime()
+  // The text over its shadow, once it has been used TEXT_CACHE_MIN_USES times
+  bool has_texture;
+  Texture2D texture;
+} CachedText;
+
+static CachedText text_cache[TEXT_CACHE_SIZE];
+static int num_cached_texts = 0;
+
+static void evict_cached_text(int i) {
+  if (text_cache[i].has_texture)
+    UnloadTexture(text_cache[i].texture);
+  free(text_cache[i].text);
+  text_cache[i] = text_cache[--num_cached_texts];
+}
+
+// Finds room for one more text, or returns false if every slot is still in
+// use. Textures are only unloaded once they haven't been drawn for
+// TEXT_CACHE_MAX_AGE, so that none is still waiting to be drawn this frame.
+static bool make_room_for_text(double now) {
+  for (int i = num_cached_texts - 1; i >= 0; i--) {
+    if (now - text_cache[i].last_used > TEXT_CACHE_MAX_AGE)
+      evict_cached_text(i);
+  }
+  if (num_cached_texts < TEXT_CACHE_SIZE)
+    return true;
+  // Text that changes every frame never gets a texture, and can go at once
+  int oldest = -1;
+  for (int i = 0; i < num_cached_texts; i++) {
+    if (!text_cache[i].has_texture && (oldest < 0 || text_cache[i].last_used < text_cache[oldest].last_used))
+      oldest = i;
+  }
+  if (oldest < 0)
+    return false;
+  evict_cached_text(oldest);
+  return true;
+}
+
+static void load_text_texture(CachedText *cached) {
+  // ImageText() logs every time it scales the default font, which would be
+  // every new text
+  SetTraceLogLevel(LOG_WARNING);
+  Image shadow = ImageText(cached->text, cached->font_size, BLACK);
+  Image front = ImageText(cached->text, cached->font_size, cached->color);
+  Image image = GenImageColor(front.width + 4, front.height + 2, BLANK);
+  ImageDraw(&image, shadow, (Rectangle){0, 0, shadow.width, shadow.height}, (Rectangle){4, 2, shadow.width, shadow.height}, WHITE);
+  ImageDraw(&image, front, (Rectangle){0, 0, front.width, front.height}, (Rectangle){0, 0, front.width, front.height}, WHITE);
+  cached->texture = LoadTextureFromImage(image);
+  cached->has_texture = true;
+  UnloadImage(shadow);
+  UnloadImage(front);
+  UnloadImage(image);
+  SetTraceLogLevel(LOG_INFO);
+}
+
+// Looks text up in the cache, adding it if it isn't there. Returns NULL if
+// the cache has no room, in which case text is drawn as it is.
+static CachedText *get_cached_text(const char *text, int font_size, Color color) {
+  size_t length = strlen(text);
+  uint64_t hash = hash_bytes(FNV_OFFSET_BASIS, text, length);
+  hash = hash_bytes(hash, &font_size, sizeof(int));
+  hash = hash_bytes(hash, &color, sizeof(Color));
+  double now = GetTime();
+  for (int i = 0; i < num_cached_texts; i++) {
+    CachedText *cached = &text_cache[i];
+    if (cached->hash == hash && cached->font_size == font_size && memcmp(&cached->color, &color, sizeof(Color)) == 0
+	&& strcmp(cached->text, text) == 0) {
+      cached->last_used = now;
+      if (++cached->num_uses >= TEXT_CACHE_MIN_USES && !cached->has_texture)
+	load_text_texture(cached);
+      return cached;
+    }
+  }
+
+  if (!make_room_for_text(now))
+    return NULL;
+  CachedText *cached = &text_cache[num_cached_texts++];
+  memset(cached, 0, sizeof(CachedText));
+  cached->hash = hash;
+  cached->text = malloc(length + 1);
+  memcpy(cached->text, text, length + 1);
+  cached->font_size = font_size;
+  cached->color = color;
+  cached->size = MeasureTextEx(GetFontDefault(), text, font_size, 0);
+  cached->width = MeasureText(text, font_size);
+  cached->num_uses = 1;
+  cached->last_used = now;
+  return cached;
+}
+
+static void draw_text_and_shadow(const char *text, int x, int y, int font_size, Color color) {
   DrawText(text, x+4, y+2, font_size, BLACK);
   DrawText(text, x, y, font_size, color);
 }
 
+static void draw_cached_text(const CachedText *cached, int x, int y) {
+  if (cached->has_texture)
+    DrawTexture(cached->texture, x, y, WHITE);
+  else
+    draw_text_and_shadow(cached->text, x, y, cached->font_size, cached->color);
+}
+
+static void draw_measured_text(CachedText *cached, const char *text, int x, int y, int font_size, Color color) {
+  if (cached != NULL)
+    draw_cached_text(cached, x, y);
+  else
+    draw_text_and_shadow(text, x, y, font_size, color);
+}
+
+void DrawShadowedText(const char *text, int x, int y, int font_size, Color color) {
+  if (text == NULL || text[0] == '\0')
+    return;
+  draw_measured_text(get_cached_text(text, font_size, color), text, x, y, font_size, color);
+}
+
+// Measures text, through the cache if it can. Returns the cached text, or NULL
+// if it isn't cached.
+static CachedText *measure_text(const char *text, int font_size, Color color, Vector2 *size) {
+  CachedText *cached = get_cached_text(text, font_size, color);
+  *size = cached != NULL ? cached->size : MeasureTextEx(GetFontDefault(), text, font_size, 0);
+  return cached;
+}
+
 void DrawShadowedTextCenter(const char *text, int x, int y, int font_size, Color color) {
-  Vector2 text_dimens = MeasureTextEx(GetFontDefault(), text, font_size, 0);
+  if (text == NULL || text[0] == '\0')
+    return;
+  Vector2 text_dimens;
+  CachedText *cached = measure_text(text, font_size, color, &text_dimens);
   x -= text_dimens.x / 2;
   y -= text_dimens.y / 2;
-  DrawText(text, x+4, y+2, font_size, BLACK);
-  DrawText(text, x, y, font_size, color);
+  draw_measured_text(cached, text, x, y, font_size, color);
 }
 
 void DrawShadowedTextNE(const char *text, int x, int y, int font_size, Color color) {
-  Vector2 text_dimens = MeasureTextEx(GetFontDefault(), text, font_size, 0);
-  DrawShadowedText(text, x-text_dimens.x, y, font_size, color);
+  if (text == NULL || text[0] == '\0')
+    return;
+  Vector2 text_dimens;
+  CachedText *cached = measure_text(text, font_size, color, &text_dimens);
+  draw_measured_text(cached, text, x-text_dimens.x, y, font_size, color);
 }
 
 void DrawShadowedTextSE(const char *text, int x, int y, int font_size, Color color) {
-  Vector2 text_dimens = MeasureTextEx(GetFontDefault(), text, font_size, 0);
-  DrawShadowedText(text, x-text_dimens.x, y-text_dimens.y, font_size, color);
+  if (text == NULL || text[0] == '\0')
+    return;
+  Vector2 text_dimens;
+  CachedText *cached = measure_text(text, font_size, color, &text_dimens);
+  draw_measured_text(cached, text, x-text_dimens.x, y-text_dimens.y, font_size, color);
 }
 
 int DrawAndMeasureShadowedText(const char *text, int x, int y, int font_size, Color color) {
-  DrawShadowedText(text, x, y, font_size, color);
-  return MeasureText(text, font_size);
-}
\ No newline at end of file
+  if (text == NULL || text[0] == '\0')
+    return 0;
+  CachedText *cached = get_cached_text(text, font_size, color);
+  if (cached == NULL) {
+    draw_text_and_shadow(text, x, y, font_size, color);
+    return MeasureText(text, font_size);
+  }
+  draw_cached_text(cached, x, y);
+  return cached->width;
+}
+
+void cleanup_text_cache() {
+  while (num_cached_texts > 0)
+    evict_cached_text(num_cached_texts - 1);
+}
+
+bool has_input_activity() {
+  Vector2 mouse_delta = GetMouseDelta();
+  if (mouse_delta.x != 0 || mouse_delta.y != 0 || GetMouseWheelMove() != 0 || IsWindowResized())
+    return true;
+  for (int key = KEY_SPACE; key <= KEY_KB_MENU; key++) {
+    if (IsKeyDown(key))
+      return true;
+  }
+  return false;
+}
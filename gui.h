@@ -1,7 +1,11 @@
 #ifndef _GUI
 #define _GUI
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "raylib.h"
+#include "wav.h"
 
 #define XMARGIN 40
 #define YMARGIN 20
@@ -15,6 +19,14 @@
 extern int screen_width;
 extern int screen_height;
 
+// Shadowed text is cached by string, size and colour: its measurements at
+// once, and the text drawn over its shadow into a texture once it has been
+// drawn TEXT_CACHE_MIN_USES times. Text that hasn't been drawn for
+// TEXT_CACHE_MAX_AGE seconds is dropped.
+#define TEXT_CACHE_SIZE 256
+#define TEXT_CACHE_MIN_USES 3
+#define TEXT_CACHE_MAX_AGE 2.0
+
 #define SHIFT_DOWN (IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT))
 
 /** I follow Raylib's CamelCase convention for the following functions. **/
@@ -23,5 +35,11 @@ void DrawShadowedTextCenter(const char *text, int x, int y, int font_size, Color
 void DrawShadowedTextNE(const char *text, int x, int y, int font_size, Color color);
 void DrawShadowedTextSE(const char *text, int x, int y, int font_size, Color color);
 int DrawAndMeasureShadowedText(const char *text, int x, int y, int font_size, Color color);
+/* Called before the window is closed */
+void cleanup_text_cache();
+
+/* True if any key is down, the mouse has moved or the window has been
+   resized since the last frame */
+bool has_input_activity();
 
 #endif
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "instrument.h"
+#include "sample.h"
+#include "loader.h"
 
 #define STB_DS_IMPLEMENTATION
 // Ignore GCC errors when compiling stb_ds.h
@@ -14,12 +16,18 @@
 #pragma GCC diagnostic pop
 
 static Instrument *instruments;
+// Kept in step with instruments
+static InstrumentInfo *instrument_infos;
 static int cur_instrument_idx = 0;
 
 Instrument *get_instruments() {
   return instruments;
 }
 
+InstrumentInfo *get_instrument_infos() {
+  return instrument_infos;
+}
+
 int get_cur_instrument_idx() {
   return cur_instrument_idx;
 }
@@ -37,15 +45,19 @@ Instrument *get_cur_instrument() {
   return &instruments[cur_instrument_idx];
 }
 
-static void init_adsr_params(ADSRParams *adsr) {
+InstrumentInfo *get_cur_instrument_info() {
+  assert(get_num_instruments() > cur_instrument_idx);
+  return &instrument_infos[cur_instrument_idx];
+}
+
+void init_adsr_params(ADSRParams *adsr) {
   adsr->attack_frames = 10;
   adsr->decay_frames = 5;
   adsr->sustain_vol = 0.7;
   adsr->release_frames = 20;
 }
 
-static void init_sample_fields(Sample *sample) {
-  memset(sample->path, 0, MAX_STR_LEN * sizeof(char));
+void init_sample_fields(Sample *sample) {
   sample->pitch_modifier = 1;
   sample->volume_modifier = 1;
   sample->play_continuously = false;
@@ -55,14 +67,31 @@ static void init_sample_fields(Sample *sample) {
   sample->is_ready = false;
   sample->sample_rate = NIL;
   sample->num_frames = NIL;
-
-  sample->is_alias = false;
-  memset(&sample->sound, 0, sizeof(Sound));
+  sample->format = PCM_F32;
   sample->data = NULL;
+  sample->num_loaded_frames = 0;
+  sample->stream = NULL;
+  sample->peaks = NULL;
 }
 
-void init_instrument(Instrument *instrument, int num) {
-  strcpy(instrument->name, TextFormat("Instrument %d", num));
+void init_sample_info_fields(SampleInfo *info) {
+  memset(info->path, 0, MAX_STR_LEN * sizeof(char));
+  info->cached = NULL;
+}
+
+// Copies the user-specified settings only, leaving the sample data alone
+void copy_sample_settings(Sample *dest, const Sample *src) {
+  dest->pitch_modifier = src->pitch_modifier;
+  dest->volume_modifier = src->volume_modifier;
+  dest->play_continuously = src->play_continuously;
+  dest->stop_on_release = src->stop_on_release;
+  dest->adsr = src->adsr;
+}
+
+void init_instrument(Instrument *instrument, InstrumentInfo *info, int num) {
+  strcpy(info->name, TextFormat("Instrument %d", num));
+  info->is_evicted = false;
+  info->last_used = 0;
   instrument->type = PULSE;
   init_adsr_params(&instrument->adsr);
   instrument->pulse_width = 0.5;
@@ -71,44 +100,50 @@ void init_instrument(Instrument *instrument, int num) {
   instrument->sine_coeffs[0] = 1;
   for (int i = 1; i < NUM_HARMONICS; i++)
     instrument->sine_coeffs[i] = 0;
-  for (int i = 0; i < NOTETABLE_SIZE; i++)
+  for (int i = 0; i < NOTETABLE_SIZE; i++) {
     init_sample_fields(&instrument->samples[i]);
+    init_sample_info_fields(&info->samples[i]);
+  }
 }
 
 void add_instrument() {
   Instrument instrument;
-  init_instrument(&instrument, get_num_instruments()+1);
+  InstrumentInfo info;
+  instrument.samples = malloc(NOTETABLE_SIZE * sizeof(Sample));
+  init_instrument(&instrument, &info, get_num_instruments()+1);
   arrput(instruments, instrument);
+  arrput(instrument_infos, info);
 }
 
 void delete_instrument(int instrument_num) {
   assert(instrument_num >= 0 && instrument_num < get_num_instruments());
-  cleanup_instrument(instrument_num);
+  // The audio thread may still be playing the samples
+  remove_sample_loads(instrument_num);
+  retire_sample_table(instruments[instrument_num].samples, instrument_infos[instrument_num].samples);
   arrdel(instruments, instrument_num);
+  arrdel(instrument_infos, instrument_num);
 }
 
 void select_previous_instrument() {
   cur_instrument_idx = clamp(cur_instrument_idx-1, 0, get_num_instruments()-1);
+  prefetch_samples_around(cur_instrument_idx);
 }
 
 void select_next_instrument() {
   cur_instrument_idx = clamp(cur_instrument_idx+1, 0, get_num_instruments()-1);
+  prefetch_samples_around(cur_instrument_idx);
 }
 
 void cleanup_instrument(int instrument_num) {
   assert(instrument_num >= 0 && instrument_num < get_num_instruments());
-  Instrument instrument = instruments[instrument_num];
+  Sample *samples = instruments[instrument_num].samples;
+  SampleInfo *infos = instrument_infos[instrument_num].samples;
   for (int note = 0; note < NOTETABLE_SIZE; note++) {
-    Sample sample = instrument.samples[note];
-    if (!sample.is_ready)
+    if (!samples[note].is_ready)
       continue;
-    if (instrument.samples[note].is_alias)
-      UnloadSoundAlias(instrument.samples[note].sound);
-    else {
-      UnloadSound(instrument.samples[note].sound);
-      UnloadWaveSamples((float *)instrument.samples[note].data);
-    }
-    init_sample_fields(&instruments[instrument_num].samples[note]);
+    unload_sample_data(&samples[note], &infos[note]);
+    init_sample_fields(&samples[note]);
+    init_sample_info_fields(&infos[note]);
   }
 }
 
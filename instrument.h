@@ -1,8 +1,10 @@
 #ifndef _INSTRUMENT
 #define _INSTRUMENT
 
+#include <stdatomic.h>
 #include "raylib.h"
 #include "note.h"
+#include "wav.h"
 
 #define MAX_STR_LEN 100
 #define NUM_HARMONICS 8
@@ -18,9 +20,13 @@ typedef struct {
   int release_frames;
 } ADSRParams;
 
+// Instruments and samples are each split in two: the fields needed to
+// synthesise a note are kept in a small "hot" struct that the audio thread
+// and per-frame updates read, while names, paths and loader handles are kept
+// in a "cold" info struct on the side.
+
 typedef struct {
   /* User-specified settings */
-  char path[MAX_STR_LEN];
   float pitch_modifier;
   float volume_modifier;
   bool play_continuously;
@@ -31,13 +37,29 @@ typedef struct {
   bool is_ready;
   int sample_rate;
   int num_frames;
-  bool is_alias;
-  Sound sound;
-  const float *data;
+  // Holds the first num_loaded_frames frames. This is all of them, unless the
+  // sample is long enough to be streamed from stream. format is one of
+  // PCM_F32, PCM_S16 or PCM_S24 (see get_sample_frames()).
+  PcmFormat format;
+  const void *data;
+  int num_loaded_frames;
+  const struct StreamSource *stream;
+  // Min/max summary of the loaded frames for drawing (see get_sample_peaks()),
+  // or NULL
+  const struct SamplePeaks *peaks;
 } Sample;
 
 typedef struct {
-  char name[MAX_STR_LEN];
+  /* User-specified settings */
+  char path[MAX_STR_LEN];
+
+  /* Internal state */
+  // The shared copy of the data that this sample holds a reference to (see
+  // load_sample_data())
+  struct CachedSample *cached;
+} SampleInfo;
+
+typedef struct {
   WaveType type;
   /* If type is MULTISAMPLE, then the ADSR parameters are stored
    * in the entries of `samples`. */
@@ -48,15 +70,34 @@ typedef struct {
   bool saw_nes_style;
   float sine_coeffs[NUM_HARMONICS];
 
-  Sample samples[NOTETABLE_SIZE];
+  /* NOTETABLE_SIZE entries, allocated separately so that copying an
+   * Instrument stays cheap. Atomic, as loading swaps in a new table while the
+   * audio thread is reading (see swap_sample_table() in loader.c). */
+  _Atomic(Sample *) samples;
 } Instrument;
 
+typedef struct {
+  char name[MAX_STR_LEN];
+  SampleInfo samples[NOTETABLE_SIZE];
+  /* Sample data is dropped from instruments that haven't been used in a
+   * while, when it no longer fits in the memory budget (see loader.h). The
+   * paths and settings are kept, so that the data can be loaded again. */
+  bool is_evicted;
+  double last_used;  // In seconds, as given by GetTime()
+} InstrumentInfo;
+
 Instrument *get_instruments();
+InstrumentInfo *get_instrument_infos();
 int get_cur_instrument_idx();
 void increment_cur_instrument_idx();
 Instrument *get_cur_instrument();
+InstrumentInfo *get_cur_instrument_info();
 int get_num_instruments();
-void init_instrument(Instrument *instrument, int num);
+void init_adsr_params(ADSRParams *adsr);
+void init_sample_fields(Sample *sample);
+void init_sample_info_fields(SampleInfo *info);
+void copy_sample_settings(Sample *dest, const Sample *src);
+void init_instrument(Instrument *instrument, InstrumentInfo *info, int num);
 void add_instrument();
 void delete_instrument(int instrument_num);
 void select_previous_instrument();
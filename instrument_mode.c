@@ -2,44 +2,69 @@
 
 #define MENU_XMARGIN 50
 #define MENU_YMARGIN 50
+#define MENU_BACKGROUND_COLOR (Color){82,64,64,255}
 #define HEADING_COLOR (Color){255,139,135,255}
 #define SELECTED_COLOR WHITE
 #define UNSELECTED_COLOR LIGHTGRAY
 
 #define CHOOSE_COLOR(cond) (cond) ? SELECTED_COLOR : UNSELECTED_COLOR
+#define BROWSER_MAX_MATCHES 6
+#define THUMBNAIL_COLUMN_WIDTH 3
+#define THUMBNAIL_HEIGHT 40
+#define SAMPLE_THUMBNAIL_WIDTH 160
+#define SAMPLE_THUMBNAIL_HEIGHT 20
 
 typedef struct {
   int note;
   // The user can expand the entry to show all sample parameters, e.g. pitch modifier
   bool is_expanded;
   Sample sample;
+  SampleInfo info;
 } MultisampleEntry;
 
 typedef struct {
+  // The instrument this state was loaded from, and will be committed to
+  int instrument_num;
   Sample sample;
+  SampleInfo sample_info;
   MultisampleEntry *multisample_entries;
 } InstrumentModeState;
 
-static InstrumentModeState mode_state;
+static InstrumentModeState mode_state = {.instrument_num = NIL};
 static int cur_row = 0;  // Current row of the GUI
+static int first_row_option = 0;  // ADD or DELETE
+
+// The menu is only drawn when something in it changes, into menu_texture,
+// which is then shown every frame with the cursor on top. menu() is run
+// twice each frame: once with handling_input set, which only updates state
+// and draws nothing, and then (if the state hash has changed) once more to
+// draw without handling any input.
+static bool handling_input = false;
+static RenderTexture2D menu_texture;
+static bool has_menu_texture = false;
+static uint64_t menu_hash = 0;
+// Where the underline under the selected option goes, found while drawing
+static Rectangle cursor = {0, 0, 0, 0};
 
 static int display_heading(const char *text, int x, int y) {
+  if (handling_input)
+    return 0;
   return DrawAndMeasureShadowedText(text, x, y, 20, HEADING_COLOR);
 }
 
 static int display_option(const char *text, int x, int y, bool should_underline, bool selected) {
+  if (handling_input)
+    return 0;
   int length = DrawAndMeasureShadowedText(text, x, y, 20, CHOOSE_COLOR(selected));
-  if (should_underline && selected) {
-    DrawLineEx((Vector2){x+2,y+21}, (Vector2){x+2+length,y+21}, 2, BLACK);
-    DrawLineEx((Vector2){x,y+20}, (Vector2){x+length,y+20}, 2, WHITE);
-  }
+  if (should_underline && selected)
+    cursor = (Rectangle){x, y+19, length, 2};
   return length;
 }
 
 static int display_text_field(char *str, int x, int y, bool should_update, bool selected) {
   int char_pos = clamp(strlen(str), 0, MAX_STR_LEN);
   int length = display_option(char_pos == 0 ? "NA" : str, x, y, should_update, selected);
-  if (should_update) {
+  if (should_update && handling_input) {
     int pressed_char = GetCharPressed();
     if (32 <= pressed_char && pressed_char <= 126)
       if (char_pos <= MAX_STR_LEN-1)
@@ -56,17 +81,71 @@ static int display_text_field(char *str, int x, int y, bool should_update, bool
   return length;
 }
 
-static void populate_sample_data(Sample *sample) {
-  const char *filepath = TextFormat("%ssamples/%s", GetApplicationDirectory(), sample->path);
-  sample->sound = LoadSound(filepath);
-  sample->is_ready = IsSoundReady(sample->sound);
-  if (sample->is_ready) {
-    sample->is_alias = false;
-    Wave wave = LoadWave(filepath);
-    sample->sample_rate = wave.sampleRate;
-    sample->num_frames = wave.frameCount;
-    sample->data = LoadWaveSamples(wave);
-    UnloadWave(wave);
+static const char *get_pitch_name(float freq) {
+  if (freq <= 0)
+    return "NONE";
+  const char *names[12] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+  float midi_key = 69 + 12 * log2f(freq / 440);
+  int key = roundf(midi_key);
+  return TextFormat("%s%d %+dc", names[mod(key, 12)], key / 12 - 1, (int)roundf(100 * (midi_key - key)));
+}
+
+static void draw_thumbnail(const LibraryEntry *entry, int x, int y) {
+  int middle = y + THUMBNAIL_HEIGHT/2;
+  for (int i = 0; i < LIBRARY_THUMBNAIL_SIZE; i++) {
+    int height = entry->thumbnail[i] * THUMBNAIL_HEIGHT / 255;
+    DrawRectangle(x + i*THUMBNAIL_COLUMN_WIDTH, middle - height/2, THUMBNAIL_COLUMN_WIDTH - 1, height + 1, WHITE);
+  }
+}
+
+// Draws the whole of a loaded sample, from the level of its peak pyramid that
+// fits the width. Draws nothing if the sample in use isn't the one at path.
+static int draw_sample_thumbnail(const Sample *sample, const SampleInfo *info, const char *path, int x, int y) {
+  if (handling_input || !sample->is_ready || strcmp(info->path, path) != 0)
+    return 0;
+  float lows[SAMPLE_THUMBNAIL_WIDTH], highs[SAMPLE_THUMBNAIL_WIDTH];
+  double frames_per_column = (double)sample->num_loaded_frames / SAMPLE_THUMBNAIL_WIDTH;
+  get_sample_peaks(sample, 0, frames_per_column, SAMPLE_THUMBNAIL_WIDTH, lows, highs);
+  int middle = y + SAMPLE_THUMBNAIL_HEIGHT/2;
+  for (int i = 0; i < SAMPLE_THUMBNAIL_WIDTH; i++) {
+    int top = middle - highs[i] * SAMPLE_THUMBNAIL_HEIGHT/2;
+    int bottom = middle - lows[i] * SAMPLE_THUMBNAIL_HEIGHT/2;
+    DrawRectangle(x + i, top, 1, bottom - top + 1, WHITE);
+  }
+  return SAMPLE_THUMBNAIL_WIDTH;
+}
+
+// Lists the files in the sample library whose names start with path, above the
+// bottom of the screen. ENTER completes path to the first of them.
+static void library_browser(char *path) {
+  LibraryEntry matches[BROWSER_MAX_MATCHES];
+  int num_matches = find_library_matches(path, matches, BROWSER_MAX_MATCHES);
+  if (handling_input) {
+    if (IsKeyPressed(KEY_ENTER) && num_matches > 0)
+      strcpy(path, matches[0].name);
+    return;
+  }
+
+  int x = XMARGIN;
+  int y = screen_height - YMARGIN - 50 - 30*min(num_matches, BROWSER_MAX_MATCHES) - THUMBNAIL_HEIGHT - 40;
+  display_heading(TextFormat("LIBRARY: %d OF %d FILES MATCH, ENTER TO COMPLETE", num_matches, get_library_size()), x, y);
+  if (num_matches == 0)
+    return;
+  y += 30;
+  draw_thumbnail(&matches[0], x, y);
+  y += THUMBNAIL_HEIGHT + 10;
+  for (int i = 0; i < min(num_matches, BROWSER_MAX_MATCHES); i++) {
+    LibraryEntry *entry = &matches[i];
+    const char *text;
+    if (!entry->is_valid)
+      text = TextFormat("%s  NOT A .WAV FILE THAT CAN BE READ", entry->name);
+    else
+      text = TextFormat("%s  %.1f KHZ %s %.2fS  PEAK %.1f DB  RMS %.1f DB  ROOT %s", entry->name,
+			entry->sample_rate / 1000.0, entry->channels == 1 ? "MONO" : entry->channels == 2 ? "STEREO" : TextFormat("%d CH", entry->channels),
+			(float)entry->num_frames / entry->sample_rate, 20 * log10f(fmaxf(entry->peak, 1e-5)),
+			20 * log10f(fmaxf(entry->rms, 1e-5)), get_pitch_name(entry->root_freq));
+    DrawShadowedText(text, x, y, 20, i == 0 ? SELECTED_COLOR : UNSELECTED_COLOR);
+    y += 30;
   }
 }
 
@@ -148,42 +227,20 @@ static char *note_to_chars(int note) {
   }
 }
 
-static void init_adsr_params(ADSRParams *adsr) {
-  adsr->attack_frames = 10;
-  adsr->decay_frames = 5;
-  adsr->sustain_vol = 0.7;
-  adsr->release_frames = 20;
-}
-
-static void init_sample_fields(Sample *sample) {
-  memset(sample->path, 0, MAX_STR_LEN * sizeof(char));
-  sample->pitch_modifier = 1;
-  sample->volume_modifier = 1;
-  sample->play_continuously = false;
-  sample->stop_on_release = false;
-  init_adsr_params(&sample->adsr);
-
-  sample->is_ready = false;
-  sample->sample_rate = NIL;
-  sample->num_frames = NIL;
-
-  sample->is_alias = false;
-  memset(&sample->sound, 0, sizeof(Sound));
-  sample->data = NULL;
-}
-
 void load_instrument_mode_state(int instrument_num) {
-  Instrument instrument = get_instruments()[instrument_num];
-  mode_state.sample = instrument.samples[0];
+  Instrument *instrument = &get_instruments()[instrument_num];
+  InstrumentInfo *info = &get_instrument_infos()[instrument_num];
+  mode_state.instrument_num = instrument_num;
+  mode_state.sample = instrument->samples[0];
+  mode_state.sample_info = info->samples[0];
 
   if (arrlenu(mode_state.multisample_entries) > 0)
     arrfree(mode_state.multisample_entries);
 
   for (int note = 0; note < NOTETABLE_SIZE; note++) {
-    Sample sample = instrument.samples[note];
-    if (strnlen(sample.path, MAX_STR_LEN) == 0)
+    if (strnlen(info->samples[note].path, MAX_STR_LEN) == 0)
       continue;
-    MultisampleEntry entry = {.note = note, .sample = sample};
+    MultisampleEntry entry = {.note = note, .sample = instrument->samples[note], .info = info->samples[note]};
     arrput(mode_state.multisample_entries, entry);
   }
 }
@@ -191,53 +248,100 @@ void load_instrument_mode_state(int instrument_num) {
 void cleanup_instrument_mode_state() {
   if (mode_state.multisample_entries != NULL)
     arrfree(mode_state.multisample_entries);
+  mode_state.instrument_num = NIL;
 }
 
-static void load_instrument(Instrument *instrument) {
-  if (instrument->type == SAMPLE) {
-    instrument->samples[0] = mode_state.sample;
-    populate_sample_data(&instrument->samples[0]);
-    // Make sample aliases
-    if (instrument->samples[0].is_ready) {
-      for (int note = 1; note < NOTETABLE_SIZE; note++) {
-	// Copy all fields over except make the sound an alias
-	instrument->samples[note] = instrument->samples[0];
-	instrument->samples[note].is_alias = true;
-	instrument->samples[note].sound = LoadSoundAlias(instrument->samples[0].sound);
-      }
-    }
+// Fills samples and infos with the settings chosen in the mode state, without
+// loading anything
+static void get_chosen_samples(WaveType type, Sample *samples, SampleInfo *infos) {
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    init_sample_fields(&samples[note]);
+    init_sample_info_fields(&infos[note]);
   }
-  else if (instrument->type == MULTISAMPLE) {
+
+  if (type == SAMPLE) {
+    copy_sample_settings(&samples[0], &mode_state.sample);
+    strcpy(infos[0].path, mode_state.sample_info.path);
+  }
+  else if (type == MULTISAMPLE) {
     for (int i = 0; i < (int)arrlenu(mode_state.multisample_entries); i++) {
       MultisampleEntry entry = mode_state.multisample_entries[i];
       if (entry.note != NIL) {
-	instrument->samples[entry.note] = entry.sample;
-	populate_sample_data(&instrument->samples[entry.note]);
+	copy_sample_settings(&samples[entry.note], &entry.sample);
+	strcpy(infos[entry.note].path, entry.info.path);
       }
     }
-    arrfree(mode_state.multisample_entries);
   }
 }
 
+// Whether the sample in use is still what path points to on disk
+static bool is_sample_unchanged(const Sample *sample, const SampleInfo *info, const char *path) {
+  return sample->is_ready && is_sample_file_unchanged(info, get_sample_file_path(path));
+}
+
+// Applies the mode state to the instrument it was loaded from. Only samples
+// whose path or file changed are reloaded (in the background). Even if none
+// did, the new settings go into a new table that is swapped in, rather than
+// being written into the table the audio thread is reading, where a block
+// could see some of a sample's settings changed and not others.
 void commit_instrument_mode_changes() {
-  cleanup_instruments();
-  for (int i = 0; i < get_num_instruments(); i++)
-    load_instrument(&get_instruments()[i]);
+  int instrument_num = mode_state.instrument_num;
+  if (instrument_num == NIL || instrument_num >= get_num_instruments())
+    return;
+  Instrument *instrument = &get_instruments()[instrument_num];
+  InstrumentInfo *info = &get_instrument_infos()[instrument_num];
+  bool share_first = instrument->type == SAMPLE;
+
+  Sample *samples = malloc(NOTETABLE_SIZE * sizeof(Sample));
+  SampleInfo infos[NOTETABLE_SIZE];
+  get_chosen_samples(instrument->type, samples, infos);
+
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    if (strnlen(infos[note].path, MAX_STR_LEN) == 0)
+      continue;
+    Sample *cur_sample = &instrument->samples[note];
+    SampleInfo *cur_info = &info->samples[note];
+    if (!is_sample_unchanged(cur_sample, cur_info, infos[note].path))
+      continue;
+    // Carry the data over
+    samples[note].is_ready = true;
+    samples[note].sample_rate = cur_sample->sample_rate;
+    samples[note].num_frames = cur_sample->num_frames;
+    samples[note].format = cur_sample->format;
+    samples[note].data = cur_sample->data;
+    samples[note].num_loaded_frames = cur_sample->num_loaded_frames;
+    samples[note].stream = cur_sample->stream;
+    samples[note].peaks = cur_sample->peaks;
+    infos[note].cached = cur_info->cached;
+  }
+
+  // The new table holds its own references to the data carried over. If
+  // everything was carried over, there is nothing to load and the table is
+  // swapped in on the next update_sample_loads(). This also replaces any load
+  // in flight, which was chosen before this state.
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    if (samples[note].is_ready)
+      retain_sample_data(&infos[note]);
+  }
+  load_samples_async(instrument_num, samples, infos, share_first);
+  cleanup_instrument_mode_state();
 }
 
 static void add_multisample_entry() {
   Sample sample;
+  SampleInfo info;
   init_sample_fields(&sample);
-  MultisampleEntry entry = {.note = NIL, .sample = sample, .is_expanded = false};
+  init_sample_info_fields(&info);
+  MultisampleEntry entry = {.note = NIL, .sample = sample, .info = info, .is_expanded = false};
   arrput(mode_state.multisample_entries, entry);
 }
 
 
 #define ON_ENTRY_AND_ROW(i,row) (cur_entry == i && cur_entryrow == row)
-#define BIND_SCROLLUP_ON_ENTRY_ROW(i,row) if (ON_ENTRY_AND_ROW(i,row) && GetMouseWheelMove() < 0)
-#define BIND_SCROLLDOWN_ON_ENTRY_ROW(i,row) if (ON_ENTRY_AND_ROW(i,row) && GetMouseWheelMove() > 0)
-#define BIND_LEFT_ON_ENTRY_ROW(i,row) if (ON_ENTRY_AND_ROW(i,row) && IsKeyPressed(KEY_LEFT) && !SHIFT_DOWN)
-#define BIND_RIGHT_ON_ENTRY_ROW(i,row) if (ON_ENTRY_AND_ROW(i,row) && IsKeyPressed(KEY_RIGHT) && !SHIFT_DOWN)
+#define BIND_SCROLLUP_ON_ENTRY_ROW(i,row) if (handling_input && ON_ENTRY_AND_ROW(i,row) && GetMouseWheelMove() < 0)
+#define BIND_SCROLLDOWN_ON_ENTRY_ROW(i,row) if (handling_input && ON_ENTRY_AND_ROW(i,row) && GetMouseWheelMove() > 0)
+#define BIND_LEFT_ON_ENTRY_ROW(i,row) if (handling_input && ON_ENTRY_AND_ROW(i,row) && IsKeyPressed(KEY_LEFT) && !SHIFT_DOWN)
+#define BIND_RIGHT_ON_ENTRY_ROW(i,row) if (handling_input && ON_ENTRY_AND_ROW(i,row) && IsKeyPressed(KEY_RIGHT) && !SHIFT_DOWN)
 
 // NIL value means that the current row is either instrument name or type
 static int cur_entry = NIL;
@@ -284,7 +388,7 @@ static void multisample_update_float_field(int entry, int entry_row, float *fiel
 }
 
 static void multisample_submenu(int *x, int *y) {
-  if (cur_entryrow == 0) {
+  if (handling_input && cur_entryrow == 0) {
     if (IsKeyPressed(KEY_LEFT))
       cur_col = clamp(cur_col-1, 0, 4);
     if (IsKeyPressed(KEY_RIGHT))
@@ -293,7 +397,12 @@ static void multisample_submenu(int *x, int *y) {
 
   int num_entries = arrlenu(mode_state.multisample_entries);
 
-  if (cur_entry >= 0 && cur_entry < num_entries) {
+  // The library browser draws as well as handling input, so it is called on
+  // both passes
+  if (cur_entry >= 0 && cur_entry < num_entries && cur_entryrow == 0 && cur_col == 1)
+    library_browser(mode_state.multisample_entries[cur_entry].info.path);
+
+  if (handling_input && cur_entry >= 0 && cur_entry < num_entries) {
     if (cur_entryrow == 0) {
       if (cur_col == 0) {  // KEYBIND
 	int pressed_char = GetCharPressed();
@@ -310,8 +419,6 @@ static void multisample_submenu(int *x, int *y) {
 	    mode_state.multisample_entries[cur_entry].note = note;
 	}
       }
-      else if (cur_col == 1) {  // SAMPLE PATH
-      }
       else if (cur_col == 2) {  // +/-
 	if (IsKeyPressed(KEY_ENTER))
 	  mode_state.multisample_entries[cur_entry].is_expanded = !mode_state.multisample_entries[cur_entry].is_expanded;
@@ -351,7 +458,10 @@ static void multisample_submenu(int *x, int *y) {
       chars = "NA";
     *x += display_option(chars, *x, *y, ON_ENTRY_AND_ROW(i, 0) && cur_col == 0, true) + 30;
     *x += display_heading("TO", *x, *y) + 30;
-    *x += display_text_field(mode_state.multisample_entries[i].sample.path, *x, *y, ON_ENTRY_AND_ROW(i, 0) && cur_col == 1, true) + 60;
+    *x += display_text_field(mode_state.multisample_entries[i].info.path, *x, *y, ON_ENTRY_AND_ROW(i, 0) && cur_col == 1, true) + 30;
+    if (entry.note != NIL)
+      *x += draw_sample_thumbnail(&get_cur_instrument()->samples[entry.note], &get_cur_instrument_info()->samples[entry.note], entry.info.path, *x, *y);
+    *x += 30;
     *x += display_option(entry.is_expanded ? "-" : "+", *x, *y, ON_ENTRY_AND_ROW(i, 0) && cur_col == 2, true) + 30;
     *x += display_option("ADD", *x, *y, ON_ENTRY_AND_ROW(i, 0) && cur_col == 3, true) + 30;
     *x += display_option("DELETE", *x, *y, ON_ENTRY_AND_ROW(i, 0) && cur_col == 4, true) + 30;
@@ -413,6 +523,8 @@ static void multisample_submenu(int *x, int *y) {
   if (cur_entry != NIL)
     is_expanded = mode_state.multisample_entries[cur_entry].is_expanded;
 
+  if (!handling_input)
+    return;
   if (IsKeyPressed(KEY_UP) && !SHIFT_DOWN) {
     if (cur_entry == 0 && cur_entryrow == 0) {
       cur_entry = NIL; cur_entryrow = NIL;
@@ -449,10 +561,10 @@ static void multisample_submenu(int *x, int *y) {
   }
 }
 
-#define BIND_SCROLLUP_ON_ROW(n) if (cur_row == n && GetMouseWheelMove() < 0)
-#define BIND_SCROLLDOWN_ON_ROW(n) if (cur_row == n && GetMouseWheelMove() > 0)
-#define BIND_LEFT_ON_ROW(n) if (cur_row == n && IsKeyPressed(KEY_LEFT) && !SHIFT_DOWN)
-#define BIND_RIGHT_ON_ROW(n) if (cur_row == n && IsKeyPressed(KEY_RIGHT) && !SHIFT_DOWN)
+#define BIND_SCROLLUP_ON_ROW(n) if (handling_input && cur_row == n && GetMouseWheelMove() < 0)
+#define BIND_SCROLLDOWN_ON_ROW(n) if (handling_input && cur_row == n && GetMouseWheelMove() > 0)
+#define BIND_LEFT_ON_ROW(n) if (handling_input && cur_row == n && IsKeyPressed(KEY_LEFT) && !SHIFT_DOWN)
+#define BIND_RIGHT_ON_ROW(n) if (handling_input && cur_row == n && IsKeyPressed(KEY_RIGHT) && !SHIFT_DOWN)
 
 static void update_bool_field(int row, bool *field) {
   BIND_LEFT_ON_ROW(row)
@@ -515,28 +627,38 @@ static void menu() {
 
   // I start from row -1 because this was the last row that I added and I am too lazy to change the numbers of the other rows
   for (int i = 0; i < get_num_instruments(); i++)
-    x += display_text_field(get_instruments()[i].name, x, y, cur_row == -1 && get_cur_instrument_idx() == i, get_cur_instrument_idx() == i) + 30;
-  BIND_LEFT_ON_ROW(-1)
+    x += display_text_field(get_instrument_infos()[i].name, x, y, cur_row == -1 && get_cur_instrument_idx() == i, get_cur_instrument_idx() == i) + 30;
+  // The mode state only covers one instrument, so it is committed before
+  // moving to another
+  BIND_LEFT_ON_ROW(-1) {
+    commit_instrument_mode_changes();
     select_previous_instrument();
-  BIND_RIGHT_ON_ROW(-1)
+    load_instrument_mode_state(get_cur_instrument_idx());
+  }
+  BIND_RIGHT_ON_ROW(-1) {
+    commit_instrument_mode_changes();
     select_next_instrument();
+    load_instrument_mode_state(get_cur_instrument_idx());
+  }
   x = MENU_XMARGIN; y += 30;
 
-  static int first_row_option = 0;
   x += display_option("ADD", x, y, cur_row == 0 && first_row_option == 0, true) + 30;
   x += display_option("DELETE", x, y, cur_row == 0 && first_row_option == 1, true) + 30;
   BIND_LEFT_ON_ROW(0)
     first_row_option = 0;
   BIND_RIGHT_ON_ROW(0)
     first_row_option = 1;
-  if (cur_row == 0 && IsKeyPressed(KEY_ENTER)) {
+  if (handling_input && cur_row == 0 && IsKeyPressed(KEY_ENTER)) {
     if (first_row_option == 0) {
+      commit_instrument_mode_changes();
       add_instrument();
       increment_cur_instrument_idx();
+      load_instrument_mode_state(get_cur_instrument_idx());
     }
     else if (first_row_option == 1 && get_num_instruments() >= 2) {
       delete_instrument(get_cur_instrument_idx());
       select_previous_instrument();
+      load_instrument_mode_state(get_cur_instrument_idx());
     }
   }
   x = MENU_XMARGIN; y += 30;
@@ -590,7 +712,10 @@ static void menu() {
 
   case SAMPLE:
     x += display_heading("SAMPLE FILE", x, y) + 30;
-    x += display_text_field(mode_state.sample.path, x, y, cur_row == 2, true) + 30;
+    x += display_text_field(mode_state.sample_info.path, x, y, cur_row == 2, true) + 30;
+    x += draw_sample_thumbnail(&get_cur_instrument()->samples[0], &get_cur_instrument_info()->samples[0], mode_state.sample_info.path, x, y);
+    if (cur_row == 2)
+      library_browser(mode_state.sample_info.path);
 
     x = MENU_XMARGIN; y += 30;
     x += display_heading("PITCH MODIFIER", x, y) + 30;
@@ -626,7 +751,7 @@ static void menu() {
   // the type is MULTISAMPLE, a more complex system is used where both the
   // current multisample entry AND the row of that entry are also stored. Hence the
   // following section is irrelevant.
-  int num_rows;
+  int num_rows = 0;
   switch (instrument->type) {
   case PULSE: case TRI: case SAW:
     num_rows = 7;
@@ -640,16 +765,92 @@ static void menu() {
   default: break;  // MULTISAMPLE case is already handled above
   }
 
-  if (IsKeyPressed(KEY_UP))
+  if (handling_input && IsKeyPressed(KEY_UP))
     cur_row = clamp(cur_row-1, -1, num_rows-1);
-  if (IsKeyPressed(KEY_DOWN))
+  if (handling_input && IsKeyPressed(KEY_DOWN))
     cur_row = clamp(cur_row+1, -1, num_rows-1);
 }
 
-void instrument_mode_gui() {
-  BeginDrawing();
-  ClearBackground((Color){82,64,64,255});
+// Everything the drawn menu depends on
+static uint64_t get_menu_hash() {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  int layout[7] = {screen_width, screen_height, cur_row, cur_entry, cur_entryrow, cur_col, first_row_option};
+  hash = hash_bytes(hash, layout, sizeof(layout));
+  int num_instruments = get_num_instruments();
+  int cur_instrument = get_cur_instrument_idx();
+  hash = hash_bytes(hash, &num_instruments, sizeof(int));
+  hash = hash_bytes(hash, &cur_instrument, sizeof(int));
+  for (int i = 0; i < num_instruments; i++)
+    hash = hash_bytes(hash, get_instrument_infos()[i].name, MAX_STR_LEN);
+  // The samples too, as the thumbnails depend on whether they are loaded
+  hash = hash_bytes(hash, get_cur_instrument(), sizeof(Instrument));
+  hash = hash_bytes(hash, get_cur_instrument()->samples, NOTETABLE_SIZE * sizeof(Sample));
+  for (int note = 0; note < NOTETABLE_SIZE; note++)
+    hash = hash_bytes(hash, get_cur_instrument_info()->samples[note].path, MAX_STR_LEN);
+  hash = hash_bytes(hash, &mode_state.sample, sizeof(Sample));
+  hash = hash_bytes(hash, &mode_state.sample_info, sizeof(SampleInfo));
+  int num_entries = arrlenu(mode_state.multisample_entries);
+  hash = hash_bytes(hash, &num_entries, sizeof(int));
+  if (num_entries > 0)
+    hash = hash_bytes(hash, mode_state.multisample_entries, num_entries * sizeof(MultisampleEntry));
+  unsigned library_generation = get_library_generation();
+  hash = hash_bytes(hash, &library_generation, sizeof(unsigned));
+  SampleMemoryStats stats = get_sample_memory_stats();
+  int num_underruns = get_num_stream_underruns();
+  hash = hash_bytes(hash, &stats, sizeof(SampleMemoryStats));
+  hash = hash_bytes(hash, &num_underruns, sizeof(int));
+  return hash;
+}
+
+static void draw_menu_texture() {
+  if (has_menu_texture && (menu_texture.texture.width != screen_width || menu_texture.texture.height != screen_height)) {
+    UnloadRenderTexture(menu_texture);
+    has_menu_texture = false;
+  }
+  if (!has_menu_texture) {
+    menu_texture = LoadRenderTexture(screen_width, screen_height);
+    has_menu_texture = true;
+  }
+
+  cursor = (Rectangle){0, 0, 0, 0};
+  BeginTextureMode(menu_texture);
+  ClearBackground(MENU_BACKGROUND_COLOR);
   DrawShadowedTextSE("INSTRUMENT", screen_width-XMARGIN-35, screen_height-YMARGIN-20, 60, WHITE);
+  SampleMemoryStats stats = get_sample_memory_stats();
+  DrawShadowedText(TextFormat("SAMPLE MEMORY %.1f/%.0f MB, %d EVICTED, %d RELOADED, %d STREAM UNDERRUNS", stats.used / 1048576.0, stats.budget / 1048576.0, stats.num_evictions, stats.num_reloads, get_num_stream_underruns()), XMARGIN, screen_height-YMARGIN-20, 20, WHITE);
+  menu();
+  EndTextureMode();
+}
+
+void update_instrument_mode() {
+  handling_input = true;
   menu();
+  handling_input = false;
+}
+
+void draw_instrument_mode() {
+  uint64_t hash = get_menu_hash();
+  if (!has_menu_texture || hash != menu_hash) {
+    draw_menu_texture();
+    menu_hash = hash;
+  }
+
+  BeginDrawing();
+  // Glyph edges leave the texture slightly transparent, so it goes over the
+  // same background it was drawn on
+  ClearBackground(MENU_BACKGROUND_COLOR);
+  // Render textures are upside down
+  DrawTextureRec(menu_texture.texture, (Rectangle){0, 0, screen_width, -screen_height}, (Vector2){0, 0}, WHITE);
+  if (cursor.width > 0) {
+    DrawRectangleRec((Rectangle){cursor.x + 2, cursor.y + 1, cursor.width, cursor.height}, BLACK);
+    DrawRectangleRec(cursor, WHITE);
+  }
   EndDrawing();
-}
\ No newline at end of file
+}
+
+void cleanup_instrument_mode_gui() {
+  if (has_menu_texture) {
+    UnloadRenderTexture(menu_texture);
+    has_menu_texture = false;
+  }
+}
@@ -9,11 +9,19 @@
 #include "globals.h"
 #include "gui.h"
 #include "instrument.h"
+#include "sample.h"
+#include "loader.h"
+#include "library.h"
 
 void load_instrument_mode_state(int instrument_num);
 void cleanup_instrument_mode_state();
 void commit_instrument_mode_changes();
 void reset_entryrow();
-void instrument_mode_gui();
+/* Handles input, every frame */
+void update_instrument_mode();
+/* Draws the screen, which may be skipped when idle (see IDLE_FPS) */
+void draw_instrument_mode();
+/* Called before the window is closed */
+void cleanup_instrument_mode_gui();
 
 #endif
\ No newline at end of file
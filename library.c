@@ -0,0 +1,311 @@
+#include "library.h"
+
+#define ANALYSIS_CHUNK_FRAMES 65536
+// Frames looked at for the root pitch, and how far after the peak they start,
+// to skip the attack
+#define PITCH_WINDOW_MS 100
+#define PITCH_OFFSET_MS 50
+// Pitch detection is done at no more than this rate, which is plenty for the
+// range it looks in
+#define PITCH_MAX_RATE 24000
+// Guards against symlink loops
+#define MAX_SCAN_DEPTH 8
+#define QUIT_POLL_NS 100000000
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_entries;
+} LibraryHeader;
+
+static char samples_dir[MAX_PATH_LEN];
+static char index_path[MAX_PATH_LEN];
+static pthread_t indexer;
+static bool is_indexer_running = false;
+static atomic_bool should_quit = false;
+// Guards entries, which is replaced as a whole after each scan
+static pthread_mutex_t library_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Sorted by name
+static LibraryEntry *entries;
+// Incremented whenever entries is replaced
+static atomic_uint generation = 0;
+
+static int compare_entries(const void *a, const void *b) {
+  return strcmp(((const LibraryEntry *)a)->name, ((const LibraryEntry *)b)->name);
+}
+
+static bool has_wav_extension(const char *name) {
+  size_t length = strlen(name);
+  if (length < 4)
+    return false;
+  const char *extension = name + length - 4;
+  return extension[0] == '.' && (extension[1] | 0x20) == 'w' && (extension[2] | 0x20) == 'a'
+    && (extension[3] | 0x20) == 'v';
+}
+
+static void load_index() {
+  FILE *f = fopen(index_path, "rb");
+  if (f == NULL)
+    return;
+  LibraryHeader header;
+  if (fread(&header, sizeof(LibraryHeader), 1, f) == 1 && memcmp(header.magic, LIBRARY_MAGIC, 8) == 0
+      && header.version == LIBRARY_VERSION) {
+    LibraryEntry *loaded = NULL;
+    arrsetlen(loaded, header.num_entries);
+    if (header.num_entries == 0 || fread(loaded, sizeof(LibraryEntry), header.num_entries, f) == header.num_entries) {
+      for (uint32_t i = 0; i < header.num_entries; i++)
+	loaded[i].name[MAX_STR_LEN-1] = '\0';
+      qsort(loaded, arrlenu(loaded), sizeof(LibraryEntry), compare_entries);
+      entries = loaded;
+    }
+    else
+      arrfree(loaded);
+  }
+  fclose(f);
+}
+
+// Written under a temporary name, like the converted samples in the disk
+// cache, so that a half written index is never read
+static void save_index(const LibraryEntry *saved) {
+  char temp_path[MAX_PATH_LEN + 8];
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", index_path);
+  FILE *f = fopen(temp_path, "wb");
+  if (f == NULL)
+    return;
+  LibraryHeader header = {.version = LIBRARY_VERSION, .num_entries = arrlenu(saved)};
+  memcpy(header.magic, LIBRARY_MAGIC, 8);
+  bool is_written = fwrite(&header, sizeof(LibraryHeader), 1, f) == 1;
+  if (arrlenu(saved) > 0)
+    is_written = is_written && fwrite(saved, sizeof(LibraryEntry), arrlenu(saved), f) == arrlenu(saved);
+  is_written = fclose(f) == 0 && is_written;
+  if (!is_written || !replace_file(temp_path, index_path)) {
+    remove(temp_path);
+    TraceLog(LOG_WARNING, "LIBRARY: Could not write %s", index_path);
+  }
+}
+
+// Decodes n frames from first_frame on into out, reading them into bytes
+// first. Frames past the end of a file that has been cut short are silent.
+static void read_analysis_frames(FILE *f, const WavInfo *wav, long long pcm_offset,
+				 int first_frame, int n, unsigned char *bytes, float *out) {
+  long long offset = pcm_offset + (long long)first_frame * wav->bytes_per_frame;
+  int num_read = read_file_at(f, offset, bytes, (size_t)n * wav->bytes_per_frame) / wav->bytes_per_frame;
+  WavInfo chunk_wav = *wav;
+  chunk_wav.pcm = bytes;
+  decode_wav_frames(&chunk_wav, 0, num_read, out);
+  memset(out + num_read, 0, (n - num_read) * sizeof(float));
+}
+
+// The file is read rather than mapped, since the user may truncate anything
+// in samples/ while it is being analysed, and reading a mapping past the new
+// end of the file would crash the program
+static void analyse_sample_file(const char *path, LibraryEntry *entry) {
+  WavInfo wav;
+  long long pcm_offset;
+  entry->is_valid = false;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return;
+  if (!read_wav_header(f, &wav, &pcm_offset) || wav.num_frames < 2) {
+    fclose(f);
+    return;
+  }
+  entry->is_valid = true;
+  entry->sample_rate = wav.sample_rate;
+  entry->channels = wav.channels;
+  entry->num_frames = wav.num_frames;
+
+  unsigned char *bytes = malloc((size_t)ANALYSIS_CHUNK_FRAMES * wav.bytes_per_frame);
+  float *chunk = malloc(ANALYSIS_CHUNK_FRAMES * sizeof(float));
+  float peak = 0;
+  double sum_of_squares = 0;
+  int peak_frame = 0;
+  memset(entry->thumbnail, 0, LIBRARY_THUMBNAIL_SIZE);
+  for (int first = 0; first < wav.num_frames; first += ANALYSIS_CHUNK_FRAMES) {
+    int n = min(ANALYSIS_CHUNK_FRAMES, wav.num_frames - first);
+    read_analysis_frames(f, &wav, pcm_offset, first, n, bytes, chunk);
+    for (int i = 0; i < n; i++) {
+      float x = fabsf(chunk[i]);
+      sum_of_squares += x * x;
+      if (x > peak) {
+	peak = x;
+	peak_frame = first + i;
+      }
+      int column = (long long)(first + i) * LIBRARY_THUMBNAIL_SIZE / wav.num_frames;
+      int height = fminf(x, 1) * 255;
+      if (height > entry->thumbnail[column])
+	entry->thumbnail[column] = height;
+    }
+  }
+  entry->peak = peak;
+  entry->rms = sqrt(sum_of_squares / wav.num_frames);
+
+  int window = (long long)wav.sample_rate * PITCH_WINDOW_MS / 1000;
+  window = min(window, min(wav.num_frames, ANALYSIS_CHUNK_FRAMES));
+  int start = peak_frame + (long long)wav.sample_rate * PITCH_OFFSET_MS / 1000;
+  if (start + window > wav.num_frames)
+    start = wav.num_frames - window;
+  read_analysis_frames(f, &wav, pcm_offset, start, window, bytes, chunk);
+  int factor = wav.sample_rate > PITCH_MAX_RATE ? wav.sample_rate / PITCH_MAX_RATE : 1;
+  int n = decimate_frames(chunk, window, factor);
+  entry->root_freq = detect_pitch(chunk, n, wav.sample_rate / factor, NULL);
+
+  free(chunk);
+  free(bytes);
+  fclose(f);
+}
+
+// Finds the entry for name in a sorted array, or returns NULL
+static LibraryEntry *search_entries(LibraryEntry *array, const char *name) {
+  LibraryEntry key;
+  strncpy(key.name, name, MAX_STR_LEN-1);
+  key.name[MAX_STR_LEN-1] = '\0';
+  return bsearch(&key, array, arrlenu(array), sizeof(LibraryEntry), compare_entries);
+}
+
+// Adds every .wav file under the directory dir (relative to samples/) to
+// found, reusing old entries for files that haven't changed. Returns the
+// number of files that had to be analysed.
+static int scan_directory(const char *dir, int depth, LibraryEntry *old, LibraryEntry **found) {
+  char dir_path[MAX_PATH_LEN];
+  if (snprintf(dir_path, MAX_PATH_LEN, "%s%s", samples_dir, dir) >= MAX_PATH_LEN)
+    return 0;
+  DIR *d = opendir(dir_path);
+  if (d == NULL)
+    return 0;
+  int num_analysed = 0;
+  struct dirent *dirent;
+  while ((dirent = readdir(d)) != NULL && !atomic_load(&should_quit)) {
+    // Also skips . and ..
+    if (dirent->d_name[0] == '.')
+      continue;
+    char name[MAX_STR_LEN], path[MAX_PATH_LEN];
+    if (snprintf(name, MAX_STR_LEN, "%s%s", dir, dirent->d_name) >= MAX_STR_LEN
+	|| snprintf(path, MAX_PATH_LEN, "%s%s", samples_dir, name) >= MAX_PATH_LEN)
+      continue;
+    struct stat st;
+    if (stat(path, &st) < 0)
+      continue;
+    if (S_ISDIR(st.st_mode)) {
+      if (depth < MAX_SCAN_DEPTH && strlen(name) + 1 < MAX_STR_LEN) {
+	strcat(name, "/");
+	num_analysed += scan_directory(name, depth + 1, old, found);
+      }
+      continue;
+    }
+    if (!has_wav_extension(name))
+      continue;
+
+    LibraryEntry entry;
+    memset(&entry, 0, sizeof(LibraryEntry));
+    strcpy(entry.name, name);
+    get_file_stamp(path, &entry.stamp);
+    LibraryEntry *old_entry = search_entries(old, name);
+    if (old_entry != NULL && is_same_file_stamp(&old_entry->stamp, &entry.stamp))
+      entry = *old_entry;
+    else {
+      analyse_sample_file(path, &entry);
+      num_analysed++;
+    }
+    arrput(*found, entry);
+  }
+  closedir(d);
+  return num_analysed;
+}
+
+static void *indexer_thread(void *arg) {
+  (void)arg;
+  struct timespec poll_interval = {0, QUIT_POLL_NS};
+  while (!atomic_load(&should_quit)) {
+    // Only this thread replaces entries, so it can read them without the lock
+    LibraryEntry *found = NULL;
+    int num_analysed = scan_directory("", 0, entries, &found);
+    if (atomic_load(&should_quit)) {
+      arrfree(found);
+      break;
+    }
+    bool has_changed = num_analysed > 0 || arrlenu(found) != arrlenu(entries);
+    if (has_changed) {
+      qsort(found, arrlenu(found), sizeof(LibraryEntry), compare_entries);
+      pthread_mutex_lock(&library_mutex);
+      LibraryEntry *old = entries;
+      entries = found;
+      atomic_fetch_add(&generation, 1);
+      pthread_mutex_unlock(&library_mutex);
+      arrfree(old);
+      if (index_path[0] != '\0')
+	save_index(entries);
+    }
+    else
+      arrfree(found);
+
+    for (int i = 0; i < LIBRARY_POLL_SECONDS * 10 && !atomic_load(&should_quit); i++)
+      nanosleep(&poll_interval, NULL);
+  }
+  return NULL;
+}
+
+void init_sample_library() {
+  snprintf(samples_dir, MAX_PATH_LEN, "%ssamples/", GetApplicationDirectory());
+  const char *cache_dir = get_sample_disk_cache_dir();
+  index_path[0] = '\0';
+  if (cache_dir[0] != '\0') {
+    snprintf(index_path, MAX_PATH_LEN, "%slibrary.idx", cache_dir);
+    load_index();
+  }
+  is_indexer_running = pthread_create(&indexer, NULL, indexer_thread, NULL) == 0;
+  if (!is_indexer_running)
+    TraceLog(LOG_WARNING, "LIBRARY: Could not start indexer thread");
+}
+
+void cleanup_sample_library() {
+  if (is_indexer_running) {
+    atomic_store(&should_quit, true);
+    pthread_join(indexer, NULL);
+    is_indexer_running = false;
+  }
+  arrfree(entries);
+}
+
+unsigned get_library_generation() {
+  return atomic_load(&generation);
+}
+
+int get_library_size() {
+  pthread_mutex_lock(&library_mutex);
+  int size = arrlenu(entries);
+  pthread_mutex_unlock(&library_mutex);
+  return size;
+}
+
+bool find_library_entry(const char *name, LibraryEntry *entry) {
+  pthread_mutex_lock(&library_mutex);
+  LibraryEntry *found = search_entries(entries, name);
+  if (found != NULL)
+    *entry = *found;
+  pthread_mutex_unlock(&library_mutex);
+  return found != NULL;
+}
+
+int find_library_matches(const char *prefix, LibraryEntry *matches, int max_matches) {
+  size_t length = strlen(prefix);
+  pthread_mutex_lock(&library_mutex);
+  // The matches are next to each other, starting from the first name that
+  // isn't before prefix
+  int low = 0, high = arrlenu(entries);
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (strcmp(entries[mid].name, prefix) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  int num_matches = 0;
+  for (int i = low; i < (int)arrlenu(entries) && strncmp(entries[i].name, prefix, length) == 0; i++) {
+    if (num_matches < max_matches)
+      matches[num_matches] = entries[i];
+    num_matches++;
+  }
+  pthread_mutex_unlock(&library_mutex);
+  return num_matches;
+}
@@ -0,0 +1,64 @@
+#ifndef _LIBRARY
+#define _LIBRARY
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "raylib.h"
+#include "stb_ds.h"
+#include "util.h"
+#include "instrument.h"
+#include "sample.h"
+#include "pitch.h"
+#include "wav.h"
+
+#define LIBRARY_THUMBNAIL_SIZE 64
+// How often the samples directory is scanned for changes
+#define LIBRARY_POLL_SECONDS 2
+#define LIBRARY_MAGIC "VIBROIDX"
+// To be bumped whenever LibraryEntry or the analysis changes
+#define LIBRARY_VERSION 1
+
+/* A background thread keeps an index of every .wav file under samples/,
+ * holding what instrument mode needs to list and check them without
+ * decoding anything. A file is only analysed again once its size or
+ * modification time changes. The index is kept in the disk cache between
+ * runs (see init_sample_disk_cache()), so it is ready as soon as the program
+ * starts. */
+
+typedef struct {
+  // Path relative to samples/, as entered in instrument mode
+  char name[MAX_STR_LEN];
+  FileStamp stamp;
+  // False if the file isn't a .wav file that can be loaded, in which case
+  // nothing below is set
+  bool is_valid;
+  int sample_rate;
+  int channels;
+  int num_frames;
+  float peak;  // Of the file mixed down to mono, as a linear amplitude
+  float rms;
+  float root_freq;  // In Hz, or 0 if the sample has no clear pitch
+  // The peak of each stretch of the sample, where 255 is full scale
+  unsigned char thumbnail[LIBRARY_THUMBNAIL_SIZE];
+} LibraryEntry;
+
+/* Called from the main thread, after init_sample_disk_cache() */
+void init_sample_library();
+void cleanup_sample_library();
+int get_library_size();
+/* Changes whenever the index does, so that what is shown of it can be kept
+   until then */
+unsigned get_library_generation();
+/* Copy the entry of the file with the given name into entry. Returns false if
+   there is no such file. */
+bool find_library_entry(const char *name, LibraryEntry *entry);
+/* Copy up to max_matches entries whose names start with prefix into matches,
+   in order of name. Returns the total number of matches. */
+int find_library_matches(const char *prefix, LibraryEntry *matches, int max_matches);
+
+#endif
@@ -0,0 +1,347 @@
+#include "loader.h"
+#include "synthesise.h"
+
+// Audio blocks that have to finish after a table is swapped out before it can
+// be freed. Each block copies the current instrument once, at its start, so a
+// block that could have seen the old table finishes within one block of the
+// swap. The second block is for good measure.
+#define GRACE_BLOCKS 2
+
+typedef struct {
+  int instrument_num;
+  Sample *samples;
+  SampleInfo infos[NOTETABLE_SIZE];
+  bool share_first;
+  int num_jobs;
+  // Written by the worker threads
+  atomic_int num_done;
+  atomic_int load_states[NOTETABLE_SIZE];
+  // Set when a newer table is queued for the same instrument, or the
+  // instrument is deleted. The table is then thrown away once done.
+  atomic_bool is_cancelled;
+} LoadBatch;
+
+typedef struct {
+  LoadBatch *batch;
+  int note;
+  char path[MAX_PATH_LEN];
+} LoadJob;
+
+typedef struct {
+  Sample *samples;
+  SampleInfo infos[NOTETABLE_SIZE];
+  unsigned retired_at;  // See get_num_audio_blocks()
+  // Streamed samples are also read by the stream reader thread, which only
+  // lets go of them after the audio thread does. NIL until then, after which
+  // it is the pass count at that time (see get_num_stream_passes()).
+  long long stream_pass;
+} RetiredTable;
+
+static pthread_t threads[NUM_LOADER_THREADS];
+static int num_threads = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+// Guarded by queue_mutex
+static LoadJob *queue;
+static bool should_quit = false;
+
+// Only touched by the GUI thread
+static LoadBatch **batches;
+static RetiredTable *retired_tables;
+static size_t memory_budget = DEFAULT_SAMPLE_MEMORY_BUDGET_MB * 1024 * 1024;
+static int num_evictions = 0;
+static int num_reloads = 0;
+
+static void run_job(LoadJob *job) {
+  LoadBatch *batch = job->batch;
+  Sample *sample = &batch->samples[job->note];
+  bool is_ready = false;
+  if (!atomic_load(&batch->is_cancelled))
+    is_ready = load_sample_data(job->path, sample, &batch->infos[job->note]);
+  sample->is_ready = is_ready;
+  atomic_store(&batch->load_states[job->note], is_ready ? LOAD_DONE : LOAD_FAILED);
+  atomic_fetch_add(&batch->num_done, 1);
+}
+
+static void *loader_thread(void *arg) {
+  (void)arg;
+  for (;;) {
+    pthread_mutex_lock(&queue_mutex);
+    while (arrlen(queue) == 0 && !should_quit)
+      pthread_cond_wait(&queue_cond, &queue_mutex);
+    if (should_quit) {
+      pthread_mutex_unlock(&queue_mutex);
+      return NULL;
+    }
+    LoadJob job = queue[0];
+    arrdel(queue, 0);
+    pthread_mutex_unlock(&queue_mutex);
+
+    run_job(&job);
+  }
+}
+
+void init_sample_loader() {
+  for (int i = 0; i < NUM_LOADER_THREADS; i++) {
+    if (pthread_create(&threads[num_threads], NULL, loader_thread, NULL) != 0) {
+      TraceLog(LOG_WARNING, "LOADER: Could not start loader thread %d", i);
+      continue;
+    }
+    num_threads++;
+  }
+  if (num_threads == 0)
+    TraceLog(LOG_WARNING, "LOADER: Loading samples on the main thread instead");
+}
+
+static void free_sample_table(Sample *samples, SampleInfo *infos) {
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    if (samples[note].is_ready)
+      unload_sample_data(&samples[note], &infos[note]);
+  }
+  free(samples);
+}
+
+static void free_batch(LoadBatch *batch) {
+  free_sample_table(batch->samples, batch->infos);
+  free(batch);
+}
+
+void cleanup_sample_loader() {
+  pthread_mutex_lock(&queue_mutex);
+  should_quit = true;
+  pthread_cond_broadcast(&queue_cond);
+  pthread_mutex_unlock(&queue_mutex);
+  for (int i = 0; i < num_threads; i++)
+    pthread_join(threads[i], NULL);
+  num_threads = 0;
+
+  arrfree(queue);
+  for (int i = 0; i < (int)arrlenu(batches); i++)
+    free_batch(batches[i]);
+  arrfree(batches);
+  for (int i = 0; i < (int)arrlenu(retired_tables); i++)
+    free_sample_table(retired_tables[i].samples, retired_tables[i].infos);
+  arrfree(retired_tables);
+}
+
+static void cancel_batches(int instrument_num) {
+  for (int i = 0; i < (int)arrlenu(batches); i++) {
+    if (batches[i]->instrument_num == instrument_num)
+      atomic_store(&batches[i]->is_cancelled, true);
+  }
+}
+
+void load_samples_async(int instrument_num, Sample *samples, const SampleInfo *infos, bool share_first) {
+  // Only the newest table for an instrument is worth finishing
+  cancel_batches(instrument_num);
+  get_instrument_infos()[instrument_num].is_evicted = false;
+
+  LoadBatch *batch = malloc(sizeof(LoadBatch));
+  batch->instrument_num = instrument_num;
+  batch->samples = samples;
+  batch->share_first = share_first;
+  batch->num_jobs = 0;
+  atomic_init(&batch->num_done, 0);
+  atomic_init(&batch->is_cancelled, false);
+
+  pthread_mutex_lock(&queue_mutex);
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    SampleInfo *info = &batch->infos[note];
+    *info = infos[note];
+    atomic_init(&batch->load_states[note], LOAD_NONE);
+
+    if (samples[note].is_ready || strnlen(info->path, MAX_STR_LEN) == 0 || (share_first && note > 0))
+      continue;
+    LoadJob job = {.batch = batch, .note = note};
+    // TextFormat() isn't thread-safe, so the path is resolved here
+    strncpy(job.path, get_sample_file_path(info->path), MAX_PATH_LEN-1);
+    job.path[MAX_PATH_LEN-1] = '\0';
+    atomic_store(&batch->load_states[note], LOAD_PENDING);
+    arrput(queue, job);
+    batch->num_jobs++;
+  }
+  pthread_cond_broadcast(&queue_cond);
+  pthread_mutex_unlock(&queue_mutex);
+
+  arrput(batches, batch);
+}
+
+void retire_sample_table(Sample *samples, const SampleInfo *infos) {
+  RetiredTable table;
+  table.samples = samples;
+  memcpy(table.infos, infos, NOTETABLE_SIZE * sizeof(SampleInfo));
+  table.retired_at = get_num_audio_blocks();
+  table.stream_pass = NIL;
+  arrput(retired_tables, table);
+}
+
+// Makes samples the instrument's table, and retires the old one
+static void swap_sample_table(int instrument_num, Sample *samples, const SampleInfo *infos) {
+  Instrument *instrument = &get_instruments()[instrument_num];
+  InstrumentInfo *info = &get_instrument_infos()[instrument_num];
+  Sample *old_samples = atomic_load_explicit(&instrument->samples, memory_order_relaxed);
+  // The table has to be fully written before the audio thread can see it.
+  // Pairs with the acquire in render_notes().
+  atomic_store_explicit(&instrument->samples, samples, memory_order_release);
+  retire_sample_table(old_samples, info->samples);
+  memcpy(info->samples, infos, NOTETABLE_SIZE * sizeof(SampleInfo));
+}
+
+static void publish_batch(LoadBatch *batch) {
+  if (batch->share_first && batch->samples[0].is_ready) {
+    for (int note = 1; note < NOTETABLE_SIZE; note++) {
+      // Every note shares the data of the first
+      batch->samples[note] = batch->samples[0];
+      batch->infos[note] = batch->infos[0];
+      retain_sample_data(&batch->infos[note]);
+    }
+  }
+
+  swap_sample_table(batch->instrument_num, batch->samples, batch->infos);
+  free(batch);
+}
+
+// Builds a table with the same settings and paths as the instrument's, but
+// nothing loaded
+static Sample *get_unloaded_table(int instrument_num, SampleInfo *infos) {
+  Sample *cur_samples = get_instruments()[instrument_num].samples;
+  SampleInfo *cur_infos = get_instrument_infos()[instrument_num].samples;
+  Sample *samples = malloc(NOTETABLE_SIZE * sizeof(Sample));
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    init_sample_fields(&samples[note]);
+    copy_sample_settings(&samples[note], &cur_samples[note]);
+    init_sample_info_fields(&infos[note]);
+    strcpy(infos[note].path, cur_infos[note].path);
+  }
+  return samples;
+}
+
+// Instruments whose data is all shared with others (such as the current
+// instrument) are passed over, as evicting them would free nothing. Otherwise
+// an instrument that is over budget by itself would have every other one
+// evicted behind it, one per frame, only for them all to be loaded again.
+static void evict_least_recently_used() {
+  InstrumentInfo *infos = get_instrument_infos();
+  int lru = NIL;
+  for (int i = 0; i < get_num_instruments(); i++) {
+    if (i == get_cur_instrument_idx() || is_loading_samples(i)
+	|| get_unshared_sample_size(infos[i].samples, NOTETABLE_SIZE) == 0)
+      continue;
+    if (lru == NIL || infos[i].last_used < infos[lru].last_used)
+      lru = i;
+  }
+  if (lru == NIL)
+    return;
+
+  SampleInfo unloaded_infos[NOTETABLE_SIZE];
+  Sample *unloaded = get_unloaded_table(lru, unloaded_infos);
+  swap_sample_table(lru, unloaded, unloaded_infos);
+  infos[lru].is_evicted = true;
+  num_evictions++;
+}
+
+static void reload_evicted_samples(int instrument_num) {
+  InstrumentInfo *info = &get_instrument_infos()[instrument_num];
+  if (!info->is_evicted)
+    return;
+  SampleInfo infos[NOTETABLE_SIZE];
+  Sample *samples = get_unloaded_table(instrument_num, infos);
+  load_samples_async(instrument_num, samples, infos, get_instruments()[instrument_num].type == SAMPLE);
+  info->last_used = GetTime();
+  num_reloads++;
+}
+
+void prefetch_samples_around(int instrument_num) {
+  reload_evicted_samples(instrument_num);
+  // The neighbours are likely to be selected next, but they aren't worth
+  // pushing anything else out for
+  for (int i = instrument_num-1; i <= instrument_num+1; i += 2) {
+    if (i >= 0 && i < get_num_instruments() && get_sample_cache_size() < memory_budget)
+      reload_evicted_samples(i);
+  }
+}
+
+void set_sample_memory_budget(size_t bytes) {
+  memory_budget = bytes;
+}
+
+SampleMemoryStats get_sample_memory_stats() {
+  return (SampleMemoryStats){
+    .used = get_sample_cache_size(),
+    .budget = memory_budget,
+    .num_evictions = num_evictions,
+    .num_reloads = num_reloads,
+  };
+}
+
+void update_sample_loads() {
+  // Without any worker threads, fall back on loading synchronously
+  if (num_threads == 0) {
+    for (int i = 0; i < (int)arrlenu(queue); i++)
+      run_job(&queue[i]);
+    arrsetlen(queue, 0);
+  }
+
+  for (int i = 0; i < (int)arrlenu(batches); i++) {
+    LoadBatch *batch = batches[i];
+    if (atomic_load(&batch->num_done) < batch->num_jobs)
+      continue;
+    arrdel(batches, i);
+    i--;
+    if (atomic_load(&batch->is_cancelled))
+      free_batch(batch);
+    else
+      publish_batch(batch);
+  }
+
+  if (get_num_instruments() > 0)
+    get_cur_instrument_info()->last_used = GetTime();
+  // Evicted data is only freed once its table is, so wait for that before
+  // checking the budget again
+  if (arrlenu(retired_tables) == 0 && get_sample_cache_size() > memory_budget)
+    evict_least_recently_used();
+
+  unsigned num_blocks = get_num_audio_blocks();
+  for (int i = 0; i < (int)arrlenu(retired_tables); i++) {
+    RetiredTable *table = &retired_tables[i];
+    if (num_blocks - table->retired_at < GRACE_BLOCKS)
+      continue;
+    if (is_streaming_enabled()) {
+      if (table->stream_pass == NIL)
+	table->stream_pass = get_num_stream_passes();
+      if (get_num_stream_passes() - (unsigned)table->stream_pass < GRACE_BLOCKS)
+	continue;
+    }
+    free_sample_table(table->samples, table->infos);
+    arrdel(retired_tables, i);
+    i--;
+  }
+}
+
+void remove_sample_loads(int instrument_num) {
+  cancel_batches(instrument_num);
+  // Instruments after the deleted one move down by one
+  for (int i = 0; i < (int)arrlenu(batches); i++) {
+    if (batches[i]->instrument_num > instrument_num)
+      batches[i]->instrument_num--;
+  }
+}
+
+static LoadBatch *get_pending_batch(int instrument_num) {
+  for (int i = 0; i < (int)arrlenu(batches); i++) {
+    if (batches[i]->instrument_num == instrument_num && !atomic_load(&batches[i]->is_cancelled))
+      return batches[i];
+  }
+  return NULL;
+}
+
+bool is_loading_samples(int instrument_num) {
+  return get_pending_batch(instrument_num) != NULL;
+}
+
+SampleLoadState get_sample_load_state(int instrument_num, int note) {
+  LoadBatch *batch = get_pending_batch(instrument_num);
+  if (batch == NULL)
+    return LOAD_NONE;
+  return atomic_load(&batch->load_states[note]);
+}
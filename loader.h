@@ -0,0 +1,60 @@
+#ifndef _LOADER
+#define _LOADER
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "raylib.h"
+#include "stb_ds.h"
+#include "util.h"
+#include "voice.h"
+#include "instrument.h"
+#include "sample.h"
+
+#define NUM_LOADER_THREADS 4
+// Can be overridden with the VIBRO_SAMPLE_MEMORY_MB environment variable
+#define DEFAULT_SAMPLE_MEMORY_BUDGET_MB 512
+
+/* Samples are loaded by a pool of worker threads, so that committing changes
+ * in instrument mode doesn't freeze the window. A whole table of samples is
+ * loaded for an instrument at once, off to the side, and only swapped in once
+ * every sample in it is done. Until then the old table stays playable. */
+
+typedef enum {
+  LOAD_NONE, LOAD_PENDING, LOAD_DONE, LOAD_FAILED
+} SampleLoadState;
+
+typedef struct {
+  size_t used;    // In bytes
+  size_t budget;  // In bytes
+  int num_evictions;
+  int num_reloads;
+} SampleMemoryStats;
+
+void init_sample_loader();
+void cleanup_sample_loader();
+/* Start loading every sample of infos that has a path. samples must be a
+ * malloc'd table of NOTETABLE_SIZE entries, which is taken over by the loader
+ * and becomes the instrument's table once loading is done. If share_first is
+ * true, only the first sample is loaded and every note plays it. Entries that
+ * are already loaded are kept as they are, along with their references. */
+void load_samples_async(int instrument_num, Sample *samples, const SampleInfo *infos, bool share_first);
+/* Swap in the tables that are done loading, and free those that the audio
+ * thread is done with. Called once per frame. */
+void update_sample_loads();
+/* To be called when an instrument is deleted */
+void remove_sample_loads(int instrument_num);
+/* Hand over a table that has been swapped out, to be freed once no audio block
+ * can still be reading it. */
+void retire_sample_table(Sample *samples, const SampleInfo *infos);
+bool is_loading_samples(int instrument_num);
+/* Whenever the loaded sample data goes over budget, the samples of the
+ * instrument that was least recently selected are unloaded, one instrument at
+ * a time. Instruments that only share data with others are skipped, since
+ * unloading them frees nothing. They are loaded again in the background when the instrument, or one
+ * next to it, is selected. */
+void set_sample_memory_budget(size_t bytes);
+void prefetch_samples_around(int instrument_num);
+SampleMemoryStats get_sample_memory_stats();
+SampleLoadState get_sample_load_state(int instrument_num, int note);
+
+#endif
@@ -0,0 +1,178 @@
+#include "meter.h"
+
+// Levels below this are reported as this, rather than as -inf
+#define METER_FLOOR_DB -120.0f
+
+typedef struct {
+  float b0, b1, b2, a1, a2;  // Normalised so that a0 = 1
+  float z1, z2;
+} Biquad;
+
+// Levels are kept as the bits of floats, as there are no atomic floats
+static atomic_uint peak_bits = 0;
+static atomic_uint rms_bits = 0;
+static atomic_uint loudness_bits = 0;
+static atomic_int num_clipped_frames = 0;
+static atomic_bool is_block_silent = true;
+
+/** Audio thread state **/
+static bool is_filter_ready = false;
+static Biquad shelf, high_pass;
+static double mean_square = 0;
+static double loudness_sum = 0;
+static int loudness_frames = 0;
+static float block_means[METER_LOUDNESS_BLOCKS];
+static int num_blocks = 0;
+
+static unsigned float_to_bits(float x) {
+  unsigned bits;
+  memcpy(&bits, &x, sizeof(float));
+  return bits;
+}
+
+static float bits_to_float(unsigned bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(float));
+  return x;
+}
+
+static float to_db(double power) {
+  return power > 0 ? fmaxf(10 * log10(power), METER_FLOOR_DB) : METER_FLOOR_DB;
+}
+
+// The two stages of the K-weighting filter, a high shelf and a high pass,
+// worked out for our sample rate from the analog prototypes that the
+// coefficients in BS.1770 (given for 48 kHz) come from
+static void init_k_weighting() {
+  double k = tan(M_PI * 1681.974450955533 / SAMPLE_RATE);
+  double q = 0.7071752369554196;
+  double high_gain = pow(10, 3.999843853973347 / 20);
+  double band_gain = pow(high_gain, 0.4996667741545416);
+  double a0 = 1 + k/q + k*k;
+  shelf = (Biquad){
+    .b0 = (high_gain + band_gain*k/q + k*k) / a0,
+    .b1 = 2 * (k*k - high_gain) / a0,
+    .b2 = (high_gain - band_gain*k/q + k*k) / a0,
+    .a1 = 2 * (k*k - 1) / a0,
+    .a2 = (1 - k/q + k*k) / a0,
+  };
+
+  k = tan(M_PI * 38.13547087613982 / SAMPLE_RATE);
+  q = 0.5003270373223665;
+  a0 = 1 + k/q + k*k;
+  high_pass = (Biquad){
+    .b0 = 1, .b1 = -2, .b2 = 1,
+    .a1 = 2 * (k*k - 1) / a0,
+    .a2 = (1 - k/q + k*k) / a0,
+  };
+  is_filter_ready = true;
+}
+
+static float filter(Biquad *f, float x) {
+  float y = f->b0 * x + f->z1;
+  f->z1 = f->b1 * x - f->a1 * y + f->z2;
+  f->z2 = f->b2 * x - f->a2 * y;
+  return y;
+}
+
+// Peak, sum of squares and number of clipped frames of a block
+static void reduce_block(const float *frames, unsigned int n, float *peak, float *sum, int *num_clipped) {
+  unsigned int i = 0;
+  float block_peak = 0, block_sum = 0;
+  int clipped = 0;
+#ifdef __SSE2__
+  const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  const __m128 full_scale = _mm_set1_ps(METER_FULL_SCALE);
+  __m128 peaks = _mm_setzero_ps(), sums = _mm_setzero_ps();
+  __m128i clips = _mm_setzero_si128();
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps(frames + i);
+    __m128 magnitude = _mm_and_ps(x, sign_mask);
+    peaks = _mm_max_ps(peaks, magnitude);
+    sums = _mm_add_ps(sums, _mm_mul_ps(x, x));
+    // Comparisons give -1 in each lane that is true
+    clips = _mm_sub_epi32(clips, _mm_castps_si128(_mm_cmpgt_ps(magnitude, full_scale)));
+  }
+  float lanes[4];
+  int clip_lanes[4];
+  _mm_storeu_ps(lanes, peaks);
+  block_peak = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+  _mm_storeu_ps(lanes, sums);
+  block_sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  _mm_storeu_si128((__m128i *)clip_lanes, clips);
+  clipped = clip_lanes[0] + clip_lanes[1] + clip_lanes[2] + clip_lanes[3];
+#endif
+  for (; i < n; i++) {
+    block_peak = fmaxf(block_peak, fabsf(frames[i]));
+    block_sum += frames[i] * frames[i];
+    clipped += fabsf(frames[i]) > METER_FULL_SCALE;
+  }
+  *peak = block_peak;
+  *sum = block_sum;
+  *num_clipped = clipped;
+}
+
+void update_meters(const float *frames, unsigned int n) {
+  if (n == 0)
+    return;
+  if (!is_filter_ready)
+    init_k_weighting();
+  const float scale = 1 / METER_FULL_SCALE;
+
+  float peak, sum;
+  int num_clipped;
+  reduce_block(frames, n, &peak, &sum, &num_clipped);
+  atomic_store(&is_block_silent, peak == 0);
+  if (num_clipped > 0)
+    atomic_fetch_add(&num_clipped_frames, num_clipped);
+  // The GUI resets the peak whenever it reads it, so only ever raise it
+  unsigned old_bits = atomic_load(&peak_bits);
+  float level = peak * scale;
+  while (level > bits_to_float(old_bits)
+	 && !atomic_compare_exchange_weak(&peak_bits, &old_bits, float_to_bits(level)))
+    ;
+
+  double decay = exp(-(double)n / (METER_RMS_SECONDS * SAMPLE_RATE));
+  mean_square = mean_square * decay + (1 - decay) * sum * scale * scale / n;
+  atomic_store(&rms_bits, float_to_bits(to_db(mean_square)));
+
+  // The filters run a frame at a time, so this is the one loop that isn't
+  // vectorised
+  for (unsigned int i = 0; i < n; i++) {
+    float x = filter(&high_pass, filter(&shelf, frames[i] * scale));
+    loudness_sum += x * x;
+    if (++loudness_frames == METER_BLOCK_FRAMES) {
+      block_means[num_blocks++ % METER_LOUDNESS_BLOCKS] = loudness_sum / METER_BLOCK_FRAMES;
+      loudness_sum = 0;
+      loudness_frames = 0;
+      int count = num_blocks < METER_LOUDNESS_BLOCKS ? num_blocks : METER_LOUDNESS_BLOCKS;
+      double total = 0;
+      for (int j = 0; j < count; j++)
+	total += block_means[j];
+      atomic_store(&loudness_bits, float_to_bits(-0.691f + to_db(total / count)));
+    }
+  }
+}
+
+float take_meter_peak() {
+  float peak = bits_to_float(atomic_exchange(&peak_bits, 0));
+  return peak > 0 ? fmaxf(20 * log10f(peak), METER_FLOOR_DB) : METER_FLOOR_DB;
+}
+
+float get_meter_rms() {
+  unsigned bits = atomic_load(&rms_bits);
+  return bits == 0 ? METER_FLOOR_DB : bits_to_float(bits);
+}
+
+float get_meter_loudness() {
+  unsigned bits = atomic_load(&loudness_bits);
+  return bits == 0 ? METER_FLOOR_DB : bits_to_float(bits);
+}
+
+bool is_output_silent() {
+  return atomic_load(&is_block_silent);
+}
+
+int get_num_clipped_frames() {
+  return atomic_load(&num_clipped_frames);
+}
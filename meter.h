@@ -0,0 +1,41 @@
+#ifndef _METER
+#define _METER
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "globals.h"
+
+// Output is clipped to this (see write_audio_samples()), which the meters
+// treat as 0 dBFS
+#define METER_FULL_SCALE 0.5
+// Time constant of the RMS meter, in seconds
+#define METER_RMS_SECONDS 0.3
+// Short-term loudness is the mean over the last METER_LOUDNESS_BLOCKS blocks
+// of METER_BLOCK_FRAMES (3 s, as in EBU R 128)
+#define METER_BLOCK_FRAMES (SAMPLE_RATE / 10)
+#define METER_LOUDNESS_BLOCKS 30
+
+/* The audio callback measures everything it outputs, before clipping, and
+ * publishes the results as atomics that the GUI reads whenever it likes.
+ * Loudness is K-weighted as in ITU-R BS.1770, in LUFS relative to
+ * METER_FULL_SCALE. */
+
+/** Called by the audio thread only **/
+void update_meters(const float *frames, unsigned int n);
+
+/* Highest absolute level since the last call, in dBFS. Resets it. */
+float take_meter_peak();
+float get_meter_rms();  // dBFS
+float get_meter_loudness();  // LUFS
+/* Frames that have been clipped since the program started */
+int get_num_clipped_frames();
+/* Whether the last block output was all zeros, which it is as soon as no
+   voice is sounding. Unlike is_silent(), safe to call from any thread. */
+bool is_output_silent();
+
+#endif
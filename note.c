@@ -14,8 +14,6 @@ static bool notetable[NOTETABLE_SIZE];
 // pressed or released.
 static bool notetable_prev[NOTETABLE_SIZE];
 
-// The state of each note
-static NoteState cur_note_states[NOTETABLE_SIZE];
 // (SOLO MODE)
 // The state of the currently played note in the previous frame. Used to
 // determine whether to execute autogliss.
@@ -24,11 +22,11 @@ static NoteState prev_note_state;
 // The note played in the previous frame.
 static int prev_note = NIL;
 
+
 /** *****************************/
 /** COMMON FUNCTIONS            */
 /** *****************************/
 
-NoteState *get_cur_note_states() { return cur_note_states; }
 int get_prev_note() { return prev_note; }
 NoteState get_prev_note_state() { return prev_note_state; }
 
@@ -41,7 +39,7 @@ void toggle_chord_mode() {
 
 bool is_any_note_playing() {
   for (int i = 0; i < NOTETABLE_SIZE; i++) {
-    NoteState s = cur_note_states[i];
+    NoteState s = voices.note_states[i];
     if (s == PRESSED || s == HELD)
       return true;
   }
@@ -50,7 +48,7 @@ bool is_any_note_playing() {
 
 bool is_any_note_pressed() {
   for (int note = 0; note < NOTETABLE_SIZE; note++) {
-    NoteState s = cur_note_states[note];
+    NoteState s = voices.note_states[note];
     if (s == PRESSED)
       return true;
   }
@@ -60,11 +58,11 @@ bool is_any_note_pressed() {
 void kill_note(int note) {
   if (is_solo_mode()) {
     if (note == get_cur_note())
-      prev_note_state = cur_note_states[note];
-    cur_note_states[note] = IDLE;
+      prev_note_state = voices.note_states[note];
+    voices.note_states[note] = IDLE;
   }
   else
-    cur_note_states[note] = IDLE;
+    voices.note_states[note] = IDLE;
 }
 
 void kill_notes() {
@@ -136,7 +134,7 @@ static void update_notetables() {
 
 int get_cur_note() {
   for (int i = 0; i < NOTETABLE_SIZE; i++)
-    if (cur_note_states[i] == PRESSED || cur_note_states[i] == HELD)
+    if (voices.note_states[i] == PRESSED || voices.note_states[i] == HELD)
       return i;
   return NIL;
 }
@@ -150,7 +148,7 @@ int get_cur_note_or_prev() {
 
 NoteState get_cur_note_state() {
   int note = get_cur_note();
-  return note == NIL ? IDLE : cur_note_states[note];
+  return note == NIL ? IDLE : voices.note_states[note];
 }
 
 bool is_legato() {
@@ -159,8 +157,8 @@ bool is_legato() {
 
 void no_attack() {
   int note = get_cur_note();
-  if (note != NIL && cur_note_states[note] == PRESSED)
-    cur_note_states[note] = HELD;
+  if (note != NIL && voices.note_states[note] == PRESSED)
+    voices.note_states[note] = HELD;
 }
 
 static void update_note_state_in_solo_mode() {
@@ -182,10 +180,10 @@ static void update_note_state_in_solo_mode() {
     }
     else if (notetable_prev[note] && !notetable[note]) {  // Note is just released
       any_released = true;
-      cur_note_states[note] = RELEASED;
+      voices.note_states[note] = RELEASED;
     }
     else
-      cur_note_states[note] = STILLRELEASED;
+      voices.note_states[note] = STILLRELEASED;
   }
 
   // Preprocessing 1. If octave is changed while note is held, pretend the held note is newly pressed.
@@ -197,7 +195,7 @@ static void update_note_state_in_solo_mode() {
   // Case 1. If a note is newly pressed, it is automatically the new current note. Kill all other notes.
   if (pressed_note != NIL) {
     kill_notes();
-    cur_note_states[pressed_note] = PRESSED;
+    voices.note_states[pressed_note] = PRESSED;
   }
   // Case 2.
   // If no new pressed notes but a note was released, then play out the held_note.
@@ -209,7 +207,7 @@ static void update_note_state_in_solo_mode() {
   else if (pressed_note == NIL && any_released && held_note != NIL) {
     int cur_note = get_cur_note();
     kill_notes();
-    cur_note_states[held_note] = (held_note == cur_note) ? HELD : PRESSED;
+    voices.note_states[held_note] = (held_note == cur_note) ? HELD : PRESSED;
   }
   // Case 3. If no new pressed or released notes but notes are still held, then stick with the
   // currently playing note.
@@ -217,7 +215,7 @@ static void update_note_state_in_solo_mode() {
     int cur_note = get_cur_note();
     kill_notes();
     if (cur_note != NIL)
-      cur_note_states[cur_note] = HELD;
+      voices.note_states[cur_note] = HELD;
   }
 }
 
@@ -229,26 +227,34 @@ static void update_note_state_in_solo_mode() {
 static void update_note_state_in_chord_mode() {
   update_notetables();
   for (int note = 0; note < NOTETABLE_SIZE; note++) {
-    if (get_cur_note_states()[note] == RELEASED)
-      cur_note_states[note] = STILLRELEASED;
+    if (voices.note_states[note] == RELEASED)
+      voices.note_states[note] = STILLRELEASED;
     else if (notetable_prev[note] && notetable[note])
-      cur_note_states[note] = HELD;
+      voices.note_states[note] = HELD;
     else if (!notetable_prev[note] && notetable[note])
-      cur_note_states[note] = PRESSED;
+      voices.note_states[note] = PRESSED;
     else if (notetable_prev[note] && !notetable[note])
-      cur_note_states[note] = RELEASED;
+      voices.note_states[note] = RELEASED;
   }
 }
 
 void update_octaves_on_release() {
   for (int note = 0; note < NOTETABLE_SIZE; note++) {
-    if (cur_note_states[note] == RELEASED)
+    if (voices.note_states[note] == RELEASED)
       update_octave_on_release(note);
   }
 }
 
+static void update_note_onsets() {
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    if (voices.note_states[note] == PRESSED)
+      voices.onsets[note]++;
+  }
+}
+
 void update_note_state() {
   if (is_chord_mode()) update_note_state_in_chord_mode();
   else update_note_state_in_solo_mode();
   update_octaves_on_release();
+  update_note_onsets();
 }
\ No newline at end of file
@@ -5,27 +5,12 @@
 #include "raylib.h"
 #include "globals.h"
 #include "octave.h"
-
-// The total number of notes that can be played via key presses
-// NOTE: the QWERTY row and number row keys are only bound to notes in chord
-// mode. In solo mode, they are not bound to anything, so the number of playable
-// notes is actually 18.
-#define NOTETABLE_SIZE 33
-
-// A note is PRESSED on the very first frame the corresponding key is pressed,
-// and RELEASED on the very first frame the corresponding key is released.
-// STILLRELEASED means the ADSR envelope for that note is at the RELEASE stage
-// (meaning it is still audible in the output), and IDLE means the note is
-// completely silent.
-typedef enum {
-  PRESSED, HELD, RELEASED, STILLRELEASED, IDLE
-} NoteState;
+#include "voice.h"
 
 /** Common functions **/
 /* NOTE: the ints that are returned refer to indices in the notetable.
    The first entry is a B, so it corresponds to 0.
    Thus, when converting these ints to frequencies based on C4, one has to first subtract by 1. */
-NoteState *get_cur_note_states();
 int get_prev_note();
 NoteState get_prev_note_state();
 bool is_chord_mode();
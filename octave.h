@@ -5,6 +5,7 @@
 #include "raylib.h"
 #include "globals.h"
 #include "util.h"
+#include "voice.h"
 
 #define MIN_OCTAVE -4
 #define MAX_OCTAVE 2
@@ -16,7 +17,6 @@ int get_local_octave_modifier();
 int get_note_octave_modifier(int note);
 int get_cur_actual_octave();
 int get_prev_actual_octave();
-int *get_octaves_on_release();
 void update_octave_on_release(int note);
 
 #endif
\ No newline at end of file
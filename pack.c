@@ -0,0 +1,297 @@
+// vibro-pack: packs the samples listed in a manifest into a sample bank (see
+// bank.h), which vibro can then load with --bank without decoding anything.
+//
+// Usage: vibro-pack MANIFEST OUTPUT.vbk
+//
+// A manifest lists instruments, each followed by its samples:
+//
+//   # Comments start with #
+//   instrument multisample Drums
+//   sample 0 kick.wav volume=0.8
+//   sample 2 snare.wav stop release=5
+//   instrument sample Bass
+//   sample 0 bass_c.wav pitch=0.5 loop attack=20 decay=10 sustain=0.6
+//
+// The type is "sample" or "multisample", followed by the name. Each sample
+// gives the note it is mapped to (ignored for "sample" instruments, which
+// only have one), the path of the .wav file relative to the manifest, and
+// then any settings: pitch=, volume=, attack=, decay=, sustain= and release=
+// (as in instrument mode), loop (play continuously) and stop (stop on
+// release). Files are converted to the engine sample rate and mixed down to
+// mono, and stored as 16-bit, 24-bit or float.
+
+#define STB_DS_IMPLEMENTATION
+#include "bank.h"
+#include "globals.h"
+#include "resample.h"
+
+#define MAX_LINE_LEN 1024
+
+typedef struct {
+  BankPcm pcm;
+  char path[MAX_LINE_LEN];
+} PackPcm;
+
+static BankInstrument *instruments;
+static PackPcm *pcms;
+static BankSample *samples;
+
+static int find_pcm(const char *name) {
+  for (int i = 0; i < (int)arrlenu(pcms); i++) {
+    if (strcmp(pcms[i].pcm.name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+// Reads the format and length of the file a pcm comes from, and decides how
+// it is stored
+static bool read_pcm_info(PackPcm *pcm) {
+  MappedFile file;
+  WavInfo wav;
+  if (!map_file(pcm->path, &file)) {
+    fprintf(stderr, "vibro-pack: could not open %s\n", pcm->path);
+    return false;
+  }
+  bool ok = parse_wav_header(&file, &wav) && wav.num_frames >= 2;
+  unmap_file(&file);
+  if (!ok) {
+    fprintf(stderr, "vibro-pack: %s is not a .wav file that can be read\n", pcm->path);
+    return false;
+  }
+  pcm->pcm.sample_rate = SAMPLE_RATE;
+  pcm->pcm.num_frames = get_resampled_length(wav.num_frames, wav.sample_rate, SAMPLE_RATE);
+  // Resampling is done in float, so only 16-bit files are worth converting
+  // back to their own format
+  if (wav.format == PCM_S16 || (wav.format == PCM_S24 && wav.sample_rate == SAMPLE_RATE))
+    pcm->pcm.format = wav.format;
+  else
+    pcm->pcm.format = PCM_F32;
+  return true;
+}
+
+static size_t get_pcm_size(const BankPcm *pcm) {
+  int frame_size = pcm->format == PCM_S16 ? 2 : pcm->format == PCM_S24 ? 3 : 4;
+  return (size_t)pcm->num_frames * frame_size;
+}
+
+// Decodes a pcm's file into a buffer in the stored format
+static void *decode_pcm(const PackPcm *pcm) {
+  MappedFile file;
+  WavInfo wav;
+  if (!map_file(pcm->path, &file) || !parse_wav_header(&file, &wav))
+    return NULL;
+  void *data;
+  if (wav.sample_rate == SAMPLE_RATE && pcm->pcm.format != PCM_F32) {
+    data = malloc(get_pcm_size(&pcm->pcm));
+    decode_wav_frames_native(&wav, 0, wav.num_frames, data);
+  }
+  else {
+    float *decoded = malloc((size_t)wav.num_frames * sizeof(float));
+    decode_wav_frames(&wav, 0, wav.num_frames, decoded);
+    if (wav.sample_rate == SAMPLE_RATE)
+      data = decoded;
+    else {
+      data = malloc((size_t)pcm->pcm.num_frames * sizeof(float));
+      resample(decoded, wav.num_frames, wav.sample_rate, data, SAMPLE_RATE);
+      free(decoded);
+    }
+    if (pcm->pcm.format == PCM_S16) {
+      float *resampled = data;
+      int16_t *converted = malloc((size_t)pcm->pcm.num_frames * sizeof(int16_t));
+      for (int i = 0; i < (int)pcm->pcm.num_frames; i++) {
+	float x = roundf(resampled[i] * 32768.0f);
+	converted[i] = x < -32768 ? -32768 : x > 32767 ? 32767 : x;
+      }
+      free(resampled);
+      data = converted;
+    }
+  }
+  unmap_file(&file);
+  return data;
+}
+
+// Parses the settings after the path of a sample line
+static bool parse_sample_settings(char *settings, BankSample *sample) {
+  for (char *word = strtok(settings, " \t\r\n"); word != NULL; word = strtok(NULL, " \t\r\n")) {
+    char *value = strchr(word, '=');
+    if (value != NULL)
+      *value++ = '\0';
+    if (strcmp(word, "loop") == 0 && value == NULL)
+      sample->play_continuously = true;
+    else if (strcmp(word, "stop") == 0 && value == NULL)
+      sample->stop_on_release = true;
+    else if (value == NULL)
+      return false;
+    else if (strcmp(word, "pitch") == 0)
+      sample->pitch_modifier = atof(value);
+    else if (strcmp(word, "volume") == 0)
+      sample->volume_modifier = atof(value);
+    else if (strcmp(word, "attack") == 0)
+      sample->attack_frames = atoi(value);
+    else if (strcmp(word, "decay") == 0)
+      sample->decay_frames = atoi(value);
+    else if (strcmp(word, "sustain") == 0)
+      sample->sustain_vol = atof(value);
+    else if (strcmp(word, "release") == 0)
+      sample->release_frames = atoi(value);
+    else
+      return false;
+  }
+  return true;
+}
+
+static bool parse_manifest(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    fprintf(stderr, "vibro-pack: could not open %s\n", path);
+    return false;
+  }
+  // Sample paths are relative to the directory of the manifest
+  const char *slash = strrchr(path, '/');
+  const char *backslash = strrchr(path, '\\');
+  if (backslash != NULL && (slash == NULL || backslash > slash))
+    slash = backslash;
+  int dir_len = slash == NULL ? 0 : slash - path + 1;
+
+  char line[MAX_LINE_LEN];
+  int line_num = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f) != NULL) {
+    line_num++;
+    char *start = line + strspn(line, " \t");
+    if (*start == '#' || *start == '\r' || *start == '\n' || *start == '\0')
+      continue;
+
+    char type[32], name[MAX_LINE_LEN];
+    int note, num_chars;
+    if (sscanf(start, "instrument %31s %n", type, &num_chars) == 1) {
+      BankInstrument instrument = {0};
+      if (strcmp(type, "sample") == 0)
+	instrument.type = SAMPLE;
+      else if (strcmp(type, "multisample") == 0)
+	instrument.type = MULTISAMPLE;
+      else
+	ok = false;
+      char *instrument_name = start + num_chars;
+      instrument_name[strcspn(instrument_name, "\r\n")] = '\0';
+      ok = ok && strlen(instrument_name) < MAX_STR_LEN;
+      if (ok) {
+	strcpy(instrument.name, instrument_name);
+	instrument.first_sample = arrlenu(samples);
+	arrput(instruments, instrument);
+      }
+    }
+    else if (sscanf(start, "sample %d %1023s %n", &note, name, &num_chars) == 2) {
+      // Same defaults as init_sample_fields()
+      BankSample sample;
+      memset(&sample, 0, sizeof(BankSample));
+      sample.note = note;
+      sample.pitch_modifier = 1;
+      sample.volume_modifier = 1;
+      sample.attack_frames = 10;
+      sample.decay_frames = 5;
+      sample.sustain_vol = 0.7;
+      sample.release_frames = 20;
+      ok = arrlenu(instruments) > 0 && note >= 0 && note < NOTETABLE_SIZE
+	&& strlen(name) < MAX_STR_LEN && dir_len + strlen(name) < MAX_LINE_LEN
+	&& parse_sample_settings(start + num_chars, &sample);
+      if (ok) {
+	int pcm = find_pcm(name);
+	if (pcm < 0) {
+	  PackPcm new_pcm;
+	  memset(&new_pcm, 0, sizeof(PackPcm));
+	  strcpy(new_pcm.pcm.name, name);
+	  snprintf(new_pcm.path, MAX_LINE_LEN, "%.*s%s", dir_len, path, name);
+	  ok = read_pcm_info(&new_pcm);
+	  pcm = arrlenu(pcms);
+	  arrput(pcms, new_pcm);
+	}
+	sample.pcm = pcm;
+	arrput(samples, sample);
+	arrlast(instruments).num_samples++;
+      }
+    }
+    else
+      ok = false;
+    if (!ok)
+      fprintf(stderr, "vibro-pack: %s:%d: could not read \"%s\"\n", path, line_num, strtok(start, "\r\n"));
+  }
+  fclose(f);
+  return ok;
+}
+
+static bool write_padding(FILE *f, uint64_t offset) {
+  static const char zeros[BANK_ALIGNMENT];
+  long pos = ftell(f);
+  return pos >= 0 && (uint64_t)pos <= offset && fwrite(zeros, 1, offset - pos, f) == offset - pos;
+}
+
+static bool write_bank(const char *path) {
+  BankHeader header;
+  memset(&header, 0, sizeof(BankHeader));
+  memcpy(header.magic, BANK_MAGIC, 8);
+  header.version = BANK_VERSION;
+  header.num_instruments = arrlenu(instruments);
+  header.num_pcms = arrlenu(pcms);
+  header.num_samples = arrlenu(samples);
+
+  uint64_t offset = sizeof(BankHeader) + header.num_instruments * sizeof(BankInstrument)
+    + header.num_pcms * sizeof(BankPcm) + header.num_samples * sizeof(BankSample);
+  for (int i = 0; i < (int)arrlenu(pcms); i++) {
+    offset = (offset + BANK_ALIGNMENT - 1) / BANK_ALIGNMENT * BANK_ALIGNMENT;
+    pcms[i].pcm.offset = offset;
+    offset += get_pcm_size(&pcms[i].pcm);
+  }
+
+  // A running vibro may have the bank mapped, and would crash reading it if
+  // it were truncated and written over. Writing a new file and renaming it
+  // over the old one leaves the old one mapped as it was.
+  char temp_path[MAX_LINE_LEN];
+  if (snprintf(temp_path, sizeof(temp_path), "%s.tmp", path) >= (int)sizeof(temp_path)) {
+    fprintf(stderr, "vibro-pack: %s is too long a path\n", path);
+    return false;
+  }
+  FILE *f = fopen(temp_path, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "vibro-pack: could not open %s for writing\n", temp_path);
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(BankHeader), 1, f) == 1;
+  if (header.num_instruments > 0)
+    ok = ok && fwrite(instruments, sizeof(BankInstrument), header.num_instruments, f) == header.num_instruments;
+  for (int i = 0; ok && i < (int)arrlenu(pcms); i++)
+    ok = fwrite(&pcms[i].pcm, sizeof(BankPcm), 1, f) == 1;
+  if (header.num_samples > 0)
+    ok = ok && fwrite(samples, sizeof(BankSample), header.num_samples, f) == header.num_samples;
+
+  // PCM is written as is, so this assumes a little-endian machine
+  for (int i = 0; ok && i < (int)arrlenu(pcms); i++) {
+    void *data = decode_pcm(&pcms[i]);
+    ok = data != NULL && write_padding(f, pcms[i].pcm.offset)
+      && fwrite(data, 1, get_pcm_size(&pcms[i].pcm), f) == get_pcm_size(&pcms[i].pcm);
+    free(data);
+    if (!ok)
+      fprintf(stderr, "vibro-pack: could not pack %s\n", pcms[i].path);
+  }
+  ok = fclose(f) == 0 && ok;
+  if (ok && !replace_file(temp_path, path)) {
+    fprintf(stderr, "vibro-pack: could not replace %s\n", path);
+    ok = false;
+  }
+  if (!ok)
+    remove(temp_path);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: vibro-pack MANIFEST OUTPUT.vbk\n");
+    return 1;
+  }
+  if (!parse_manifest(argv[1]) || !write_bank(argv[2]))
+    return 1;
+  printf("Packed %d instruments and %d sample files into %s\n",
+	 (int)arrlenu(instruments), (int)arrlenu(pcms), argv[2]);
+  return 0;
+}
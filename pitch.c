@@ -0,0 +1,94 @@
+#include "pitch.h"
+
+// Dot product of a and b, in four independent sums so that it pipelines (and
+// vectorises)
+static float correlate(const float *a, const float *b, int n) {
+  float sums[4] = {0, 0, 0, 0};
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int j = 0; j < 4; j++)
+      sums[j] += a[i + j] * b[i + j];
+  }
+  for (; i < n; i++)
+    sums[0] += a[i] * b[i];
+  return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+int decimate_frames(float *frames, int n, int factor) {
+  int m = n / factor;
+  for (int i = 0; i < m; i++) {
+    float sum = 0;
+    for (int j = 0; j < factor; j++)
+      sum += frames[i*factor + j];
+    frames[i] = sum / factor;
+  }
+  return m;
+}
+
+float detect_pitch(const float *frames, int n, int sample_rate, float *clarity) {
+  if (clarity != NULL)
+    *clarity = 0;
+  int min_lag = sample_rate / PITCH_MAX_FREQ;
+  int max_lag = sample_rate / PITCH_MIN_FREQ;
+  if (min_lag < 2)
+    min_lag = 2;
+  // Each lag is compared over the same number of frames. The last lag is
+  // max_lag + 1 (for the parabola fit), which must still be inside frames.
+  int window = n - max_lag - 1;
+  if (window < max_lag)
+    return 0;
+
+  // Cumulative mean normalised difference, which starts at 1 and dips towards
+  // 0 at multiples of the period. The squared difference at each lag is
+  // expanded into the energies of the two stretches compared, which are kept
+  // up to date from one lag to the next, less twice their correlation, so that
+  // only the correlation needs a pass over the window.
+  float *difference = malloc((max_lag + 2) * sizeof(float));
+  double running_sum = 0;
+  double first_energy = 0;
+  for (int i = 0; i < window; i++)
+    first_energy += frames[i] * frames[i];
+  double lag_energy = first_energy;
+  difference[0] = 1;
+  for (int lag = 1; lag <= max_lag + 1; lag++) {
+    lag_energy += frames[window + lag - 1] * frames[window + lag - 1] - frames[lag - 1] * frames[lag - 1];
+    double sum = first_energy + lag_energy - 2 * correlate(frames, frames + lag, window);
+    sum = sum > 0 ? sum : 0;
+    running_sum += sum;
+    difference[lag] = running_sum > 0 ? sum * lag / running_sum : 1;
+  }
+
+  // The first dip under the threshold is the period; later ones are its
+  // multiples. Failing that, the deepest dip is used if it is deep enough.
+  int period = 0;
+  for (int lag = min_lag; lag <= max_lag; lag++) {
+    if (difference[lag] < PITCH_THRESHOLD) {
+      while (lag + 1 <= max_lag && difference[lag + 1] < difference[lag])
+	lag++;
+      period = lag;
+      break;
+    }
+  }
+  if (period == 0) {
+    int best = min_lag;
+    for (int lag = min_lag; lag <= max_lag; lag++) {
+      if (difference[lag] < difference[best])
+	best = lag;
+    }
+    if (difference[best] < 2 * PITCH_THRESHOLD)
+      period = best;
+  }
+  if (period == 0) {
+    free(difference);
+    return 0;
+  }
+
+  // Fit a parabola through the dip for a period between whole frames
+  float a = difference[period - 1], b = difference[period], c = difference[period + 1];
+  float denominator = a - 2*b + c;
+  float offset = fabsf(denominator) > 1e-9f ? 0.5f * (a - c) / denominator : 0;
+  if (clarity != NULL)
+    *clarity = 1 - fminf(b, 1);
+  free(difference);
+  return sample_rate / (period + offset);
+}
@@ -0,0 +1,24 @@
+#ifndef _PITCH
+#define _PITCH
+
+#include <math.h>
+#include <stdlib.h>
+
+// Range of fundamentals that are looked for, in Hz
+#define PITCH_MIN_FREQ 40
+#define PITCH_MAX_FREQ 2000
+// How far below 1 the normalised difference of a period has to dip for it to
+// count (see detect_pitch())
+#define PITCH_THRESHOLD 0.15
+
+/* Estimate the fundamental frequency of n frames of mono audio with the YIN
+   method. Returns 0 if no clear pitch is found. n should cover at least two
+   periods of PITCH_MIN_FREQ, plus one frame. If clarity isn't NULL, it is set
+   to how periodic the frames are, from 0 to 1. */
+float detect_pitch(const float *frames, int n, int sample_rate, float *clarity);
+/* Average every factor frames into one, in place, as a cheap way down to a
+   rate that detect_pitch() gets through quickly. Returns the number of frames
+   left. */
+int decimate_frames(float *frames, int n, int factor);
+
+#endif
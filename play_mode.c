@@ -26,13 +26,24 @@ static void display_note_text_solo_mode() {
 #undef match_scale_degree_with_text
 
   DrawShadowedText(note_text, XMARGIN, YMARGIN+20, 40, WHITE);
+
+  // What is actually coming out, against the note being played
+  TunerReading reading = get_tuner_reading();
+  float target = get_note_freq(get_cur_note() - 1, get_cur_actual_octave());
+  if (reading.freq <= 0 || target <= 0)
+    return;
+  const char *names[12] = {"C-", "C#", "D-", "D#", "E-", "F-", "F#", "G-", "G#", "A-", "A#", "B-"};
+  int key = roundf(69 + 12 * log2f(reading.freq / 440));
+  int cents = roundf(1200 * log2f(reading.freq / target));
+  DrawShadowedText(TextFormat("%s%d %+dc", names[mod(key, 12)], key / 12 - 1, cents),
+		   XMARGIN, YMARGIN+62, 20, abs(cents) <= TUNER_IN_TUNE_CENTS ? WHITE : RED);
 }
 
 static void display_note_text_chord_mode() {
   int notes_playing[6] = {-1, -1, -1, -1, -1, -1};
   int counter = 0;
   for (int note = 0; note < NOTETABLE_SIZE; note++) {
-    NoteState s = get_cur_note_states()[note];
+    NoteState s = voices.note_states[note];
     if (s == PRESSED || s == HELD) {
       notes_playing[counter++] = note;
       if (counter >= 6) break;
@@ -114,6 +125,62 @@ static void draw_volume_level() {
   DrawLineEx(v3, v1, 3, WHITE);
 }
 
+// One bar per meter, to the right of the volume level, with the clip count
+// after them
+static void draw_meters() {
+  // The peak meter falls back gradually, so that short peaks can be read
+  static float peak = METER_DISPLAY_MIN_DB;
+  peak = fmaxf(take_meter_peak(), peak - METER_PEAK_FALL_DB_PER_SECOND * GetFrameTime());
+  float levels[3] = {peak, get_meter_rms(), get_meter_loudness()};
+  const char *labels[3] = {"PK", "RMS", "LU"};
+  int x = XMARGIN + 340;
+  for (int i = 0; i < 3; i++) {
+    int y = YMARGIN + 10 + i * 15;
+    float fill = fclamp(1 - levels[i] / METER_DISPLAY_MIN_DB, 0, 1);
+    DrawShadowedText(labels[i], x, y, 10, WHITE);
+    DrawRectangle(x + 33, y + 2, METER_WIDTH, 8, BLACK);
+    DrawRectangle(x + 30, y, fill * METER_WIDTH, 8, levels[i] > 0 ? RED : WHITE);
+    DrawShadowedText(TextFormat("%.1f", levels[i]), x + METER_WIDTH + 40, y, 10, WHITE);
+  }
+  int num_clipped = get_num_clipped_frames();
+  if (num_clipped > 0)
+    DrawShadowedText(TextFormat("CLIP %d", num_clipped), x, YMARGIN + 55, 10, RED);
+}
+
+// One box per sample being loaded for the current instrument, filled in as
+// each is done (red if it couldn't be loaded)
+static void draw_sample_load_progress() {
+  int instrument_num = get_cur_instrument_idx();
+  if (!is_loading_samples(instrument_num))
+    return;
+
+  int num_jobs = 0, num_done = 0;
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    SampleLoadState state = get_sample_load_state(instrument_num, note);
+    if (state == LOAD_NONE)
+      continue;
+    num_jobs++;
+    if (state != LOAD_PENDING)
+      num_done++;
+  }
+
+  int box_size = 12, box_spacing = 4;
+  int x = screen_width/2 - (num_jobs * (box_size+box_spacing) - box_spacing) / 2;
+  int y = screen_height - YMARGIN - 60;
+  DrawShadowedTextCenter(TextFormat("LOADING SAMPLES %d/%d", num_done, num_jobs), screen_width/2, y - 25, 20, WHITE);
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    SampleLoadState state = get_sample_load_state(instrument_num, note);
+    if (state == LOAD_NONE)
+      continue;
+    DrawRectangle(x+2, y+2, box_size, box_size, BLACK);
+    if (state == LOAD_PENDING)
+      DrawRectangleLines(x, y, box_size, box_size, WHITE);
+    else
+      DrawRectangle(x, y, box_size, box_size, state == LOAD_DONE ? WHITE : RED);
+    x += box_size + box_spacing;
+  }
+}
+
 static void draw_straight_line() {
   Vector2 start = {0, screen_height/2};
   Vector2 end = {screen_width, screen_height/2};
@@ -123,105 +190,149 @@ static void draw_straight_line() {
   DrawLineEx(start, end, 3, WHITE);
 }
 
-static void draw_wave_sample(Sample *samples) {
+// Lowest and highest amplitude of the wave within each screen column, and the
+// vertices of the strip it is drawn as. Kept from frame to frame, and only
+// grown when the window gets wider.
+static float *wave_lows = NULL;
+static float *wave_highs = NULL;
+static Vector2 *wave_strip = NULL;
+// The same for one sample at a time, before they are added together
+static float *sample_lows = NULL;
+static float *sample_highs = NULL;
+static int wave_capacity = 0;
+
+static void reserve_wave_columns(int num_columns) {
+  if (wave_capacity >= num_columns)
+    return;
+  wave_lows = realloc(wave_lows, num_columns * sizeof(float));
+  wave_highs = realloc(wave_highs, num_columns * sizeof(float));
+  wave_strip = realloc(wave_strip, 2 * num_columns * sizeof(Vector2));
+  sample_lows = realloc(sample_lows, num_columns * sizeof(float));
+  sample_highs = realloc(sample_highs, num_columns * sizeof(float));
+  wave_capacity = num_columns;
+}
+
+// Draws the band between wave_lows and wave_highs as a single triangle strip,
+// at least 2 pixels thick. Each vertex pair spans one column, top first, which
+// is the winding raylib's own lines use.
+static void draw_wave_strip(int num_columns, int dx, int dy, Color color) {
+  for (int i = 0; i < num_columns; i++) {
+    float top = screen_height / 2 - 300 * wave_highs[i] - 1;
+    float bottom = screen_height / 2 - 300 * wave_lows[i] + 1;
+    wave_strip[2*i] = (Vector2){i + dx, top + dy};
+    wave_strip[2*i + 1] = (Vector2){i + dx, bottom + dy};
+  }
+  DrawTriangleStrip(wave_strip, 2 * num_columns, color);
+}
+
+static void draw_wave_columns(int num_columns) {
+  // Shadow
+  draw_wave_strip(num_columns, 3, 2, BLACK);
+  // Actual
+  draw_wave_strip(num_columns, 0, 0, WHITE);
+}
+
+static void draw_wave_sample(Sample *samples, SampleInfo *infos) {
   for (int note = 0; note < NOTETABLE_SIZE; note++) {
-    if (strnlen(samples[note].path, MAX_STR_LEN) > 0 && !samples[note].is_ready) {
-      DrawShadowedTextCenter(TextFormat("Sample not found: %s", samples[note].path), screen_width/2, screen_height/2, 40, WHITE);
+    if (strnlen(infos[note].path, MAX_STR_LEN) > 0 && !samples[note].is_ready && !is_loading_samples(get_cur_instrument_idx())) {
+      DrawShadowedTextCenter(TextFormat("Sample not found: %s", infos[note].path), screen_width/2, screen_height/2, 40, WHITE);
       return;
     }
   }
 
-  NoteState *note_states = get_cur_note_states();
-  SamplePlaybackState *playback_states = get_sample_playback_states();
-  float *actual_vols = get_actual_vols();
-  float amplitude;
-  float next_amplitude = 0;
-  int y, next_y;
-
-  for (int i = 0; i < screen_width; i += 1) {
-    amplitude = next_amplitude;
-    next_amplitude = 0;
-
-    for (int note = 0; note < NOTETABLE_SIZE; note++) {
-      Sample sample = samples[note];
-      if (!sample.is_ready || !IsSoundPlaying(sample.sound) || (note_states[note] == RELEASED && sample.stop_on_release)) {
-	if (note == 0 && note_states[note] == RELEASED)
-	  printf("hi\n");
-	continue;
-      }
-      int frame_counter = playback_states[note].sample_frame_counter;
-      float pitch_modifier = playback_states[note].pitch_modifier;
-
-      if (frame_counter + (i+1)*pitch_modifier < sample.num_frames)
-	//next_amplitude += sample.data[frame_counter + (int)((i+1)*pitch_modifier)] * sample.volume_modifier * get_note_vol();
-	next_amplitude += sample.data[frame_counter + (int)((i+1)*pitch_modifier)] * sample.volume_modifier * actual_vols[note];
-    }
+  // The envelope of the samples playing together is the sum of theirs
+  float *actual_vols = voices.vols;
+  reserve_wave_columns(screen_width);
+  for (int i = 0; i < screen_width; i++)
+    wave_lows[i] = wave_highs[i] = 0;
 
-    y = screen_height / 2 - 300 * amplitude;
-    next_y = screen_height / 2 - 300 * next_amplitude;
-
-    // Shadow
-    Vector2 start_shadow = {i+3, y+2};
-    Vector2 end_shadow = {i+5, next_y+2};
-    DrawLineEx(start_shadow, end_shadow, 2, BLACK);
-    // Actual
-    Vector2 start = {i, y};
-    Vector2 end = {i+2, next_y};
-    DrawLineEx(start, end, 2, WHITE);
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    Sample *sample = &samples[note];
+    if (!sample->is_ready || !voices.sample_playing[note])
+      continue;
+    // Shows the upcoming part of the sample, at the speed it is being played
+    get_sample_peaks(sample, voices.sample_positions[note], voices.freqs[note], screen_width, sample_lows, sample_highs);
+    float gain = sample->volume_modifier * actual_vols[note];
+    for (int i = 0; i < screen_width; i++) {
+      wave_lows[i] += sample_lows[i] * gain;
+      wave_highs[i] += sample_highs[i] * gain;
+    }
   }
+  draw_wave_columns(screen_width);
 }
 
-static void draw_wave_periodic() {
+// Draws what was last output, starting from a rising zero crossing so that
+// periodic waves stand still
+static void draw_scope() {
   if (is_silent()) {
     draw_straight_line();
     return;
   }
 
-  // TODO phase is a bad word, find a replacement
-  float dphase = 1.0 / 30000.0;
-  float start_phase = fmodf2((float)GetTime(), WAVESPEED) / WAVESPEED;
-  float phases[NOTETABLE_SIZE], next_phases[NOTETABLE_SIZE];
-  float amplitude, next_amplitude;
-  int y, next_y;
-  float *cur_actual_freqs = get_cur_actual_freqs();
-  NoteState *note_states = get_cur_note_states();
-
-  for (int note = 0; note < NOTETABLE_SIZE; note++)
-    next_phases[note] = start_phase;
-
-  for (int i = 0; i < screen_width; i += 1) {
-    for (int note = 0; note < NOTETABLE_SIZE; note++) {
-      if (note_states[4]) {}
-      phases[note] = next_phases[note];
-      next_phases[note] += dphase * cur_actual_freqs[note];
-      if (next_phases[note] > 1)
-        next_phases[note] -= 1;
+  static float *frames = NULL;
+  static int capacity = 0;
+  float frames_per_pixel = (float)SAMPLE_RATE / SCOPE_PIXELS_PER_SECOND;
+  int display_frames = screen_width * frames_per_pixel + 2;
+  int num_frames = min(display_frames + SCOPE_TRIGGER_FRAMES, SCOPE_RING_SIZE/2);
+  display_frames = num_frames - SCOPE_TRIGGER_FRAMES;
+  if (capacity < num_frames) {
+    frames = realloc(frames, num_frames * sizeof(float));
+    capacity = num_frames;
+  }
+  if (!read_scope_frames(frames, num_frames)) {
+    draw_straight_line();
+    return;
+  }
+  int trigger = find_scope_trigger(frames, num_frames, display_frames);
+
+  // Each column covers the frames from its left edge to the next column's,
+  // both included, so that neighbouring columns join up
+  int num_columns = min(screen_width, (int)((num_frames - 1 - trigger) / frames_per_pixel));
+  reserve_wave_columns(num_columns);
+  for (int i = 0; i < num_columns; i++) {
+    int first = trigger + (int)(i * frames_per_pixel);
+    int last = min(trigger + (int)ceilf((i+1) * frames_per_pixel), num_frames - 1);
+    float low = frames[first], high = frames[first];
+    for (int frame = first + 1; frame <= last; frame++) {
+      low = fminf(low, frames[frame]);
+      high = fmaxf(high, frames[frame]);
+    }
+    wave_lows[i] = low;
+    wave_highs[i] = high;
+  }
+  draw_wave_columns(num_columns);
+}
+
+// One bar per band, with a tick for the peak held above it
+static void draw_spectrum() {
+  static Spectrum spectrum;
+  get_spectrum(&spectrum);
+  int x = XMARGIN;
+  int bottom = screen_height - YMARGIN;
+  float band_width = (float)SPECTRUM_PANEL_WIDTH / SPECTRUM_NUM_BANDS;
+  for (int band = 0; band < SPECTRUM_NUM_BANDS; band++) {
+    float level = 1 - spectrum.levels[band] / SPECTRUM_FLOOR_DB;
+    float peak = 1 - spectrum.peaks[band] / SPECTRUM_FLOOR_DB;
+    float left = x + band * band_width;
+    float height = level * SPECTRUM_PANEL_HEIGHT;
+    float peak_y = bottom - peak * SPECTRUM_PANEL_HEIGHT;
+    DrawRectangleRec((Rectangle){left, bottom - height, band_width - 1, height}, Fade(WHITE, 0.5));
+    if (peak > 0) {
+      DrawRectangleRec((Rectangle){left + 3, peak_y + 2, band_width - 1, 2}, BLACK);
+      DrawRectangleRec((Rectangle){left, peak_y, band_width - 1, 2}, WHITE);
     }
-    amplitude = get_amplitude(phases);
-    next_amplitude = get_amplitude(next_phases);
-    y = screen_height / 2 - 300 * amplitude;
-    next_y = screen_height / 2 - 300 * next_amplitude;
-
-    // Shadow
-    Vector2 start_shadow = {i+3, y+2};
-    Vector2 end_shadow = {i+5, next_y+2};
-    DrawLineEx(start_shadow, end_shadow, 2, BLACK);
-    // Actual
-    Vector2 start = {i, y};
-    Vector2 end = {i+2, next_y};
-    DrawLineEx(start, end, 2, WHITE);
   }
 }
 
 void draw_wave() {
-  Instrument instrument = *get_cur_instrument();
-  if (instrument.type == SAMPLE || instrument.type == MULTISAMPLE)
-    draw_wave_sample(instrument.samples);
+  Instrument *instrument = get_cur_instrument();
+  if (instrument->type == SAMPLE || instrument->type == MULTISAMPLE)
+    draw_wave_sample(instrument->samples, get_cur_instrument_info()->samples);
   else
-    draw_wave_periodic();
+    draw_scope();
 }
 
-void play_mode_gui() {
+void update_play_mode() {
   mouse_dx = GetMouseDelta().x;
   mouse_dy = GetMouseDelta().y;
   if (fabs(mouse_dx) >= fabs(mouse_dy)) mouse_dy = 0;
@@ -257,33 +368,24 @@ void play_mode_gui() {
 
   update_note_vol();
   apply_adsr();
+  record_roll_frame();
+}
 
-  Instrument instrument = *get_cur_instrument();
-  if (instrument.type == SAMPLE) {
-    for (int note = 0; note < NOTETABLE_SIZE; note++)
-      handle_sample_playback(note, instrument.samples[note]);
-  }
-  else if (instrument.type == MULTISAMPLE) {
-    if (is_solo_mode()) {
-      int note = get_cur_note_or_prev();
-      if (note != NIL)
-	handle_sample_playback(note, instrument.samples[note]);
-    }
-    else if (is_chord_mode()) {
-      for (int note = 0; note < NOTETABLE_SIZE; note++)
-	handle_sample_playback(note, instrument.samples[note]);
-    }
-  }
-
+void draw_play_mode() {
+  update_roll_texture();
   BeginDrawing();
     ClearBackground((Color){64,82,74,255});
     draw_wave();
+    draw_spectrum();
+    draw_roll(screen_width - XMARGIN - ROLL_WIDTH, YMARGIN + 70);
     display_octave_text();
     display_note_text();
     display_mode_text();
     draw_volume_level();
+    draw_meters();
 
-    DrawShadowedTextCenter(instrument.name, screen_width/2, screen_height-YMARGIN-20, 30, WHITE);
+    draw_sample_load_progress();
+    DrawShadowedTextCenter(get_cur_instrument_info()->name, screen_width/2, screen_height-YMARGIN-20, 30, WHITE);
     if (is_recording) {
       DrawShadowedTextNE("REC", screen_width-XMARGIN, YMARGIN, 30, WHITE);
       DrawShadowedTextNE(TextFormat("out%d.wav", recording_count), screen_width-XMARGIN-10, YMARGIN+30, 20, WHITE);
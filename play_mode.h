@@ -9,10 +9,30 @@
 #include "synthesise.h"
 #include "gui.h"
 #include "sample.h"
+#include "loader.h"
+#include "analysis.h"
+#include "roll.h"
 
-// Number of seconds for the drawn wave to move one full cycle
-#define WAVESPEED 2.0
+// Horizontal scale of the scope: each pixel is 1/SCOPE_PIXELS_PER_SECOND s
+#define SCOPE_PIXELS_PER_SECOND 30000
+// The scope looks this far back for a trigger, which covers a full period of
+// anything down to 20 Hz
+#define SCOPE_TRIGGER_FRAMES (SAMPLE_RATE / 20)
+// The spectrum panel, in the bottom left corner
+#define SPECTRUM_PANEL_WIDTH 320
+#define SPECTRUM_PANEL_HEIGHT 100
+// The tuner reading is shown in red when it is further than this from the
+// note being played
+#define TUNER_IN_TUNE_CENTS 10
+// Meters show levels from this up to 0 dBFS, and the peak meter falls back
+// at this rate
+#define METER_DISPLAY_MIN_DB -60.0
+#define METER_WIDTH 150
+#define METER_PEAK_FALL_DB_PER_SECOND 20.0
 
-void play_mode_gui();
+/* Handles input and runs the control-rate updates, every frame */
+void update_play_mode();
+/* Draws the screen, which may be skipped when idle (see IDLE_FPS) */
+void draw_play_mode();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "resample.h"
+
+static long long gcd(long long a, long long b) {
+  while (b != 0) {
+    long long t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser
+// window
+static double bessel_i0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2*k)) * (x / (2*k));
+    sum += term;
+  }
+  return sum;
+}
+
+int get_resampled_length(int num_frames, int from_rate, int to_rate) {
+  return ((long long)num_frames * to_rate + from_rate - 1) / from_rate;
+}
+
+void resample(const float *in, int num_frames, int from_rate, float *out, int to_rate) {
+  // Output frame n is at input position n * down / up
+  long long g = gcd(to_rate, from_rate);
+  long long up = to_rate / g;
+  long long down = from_rate / g;
+  int num_phases = up < RESAMPLE_MAX_PHASES ? up : RESAMPLE_MAX_PHASES;
+
+  // Cutoff in cycles per input frame
+  double cutoff = 0.5 * RESAMPLE_ROLLOFF;
+  if (down > up)
+    cutoff *= (double)up / down;
+  int half_taps = ceil(RESAMPLE_HALF_TAPS * 0.5 * RESAMPLE_ROLLOFF / cutoff);
+  int num_taps = 2 * half_taps;
+
+  // Phase p is for output frames that fall p/num_phases of the way between
+  // two input frames. Tap k of it applies to input frame (k - half_taps + 1)
+  // relative to the one before.
+  float *filter = malloc((size_t)num_phases * num_taps * sizeof(float));
+  double window_norm = bessel_i0(RESAMPLE_KAISER_BETA);
+  for (int p = 0; p < num_phases; p++) {
+    float *h = filter + (size_t)p * num_taps;
+    double sum = 0;
+    for (int k = 0; k < num_taps; k++) {
+      double t = (k - half_taps + 1) - (double)p / num_phases;
+      double x = 2 * cutoff * t;
+      double sinc = fabs(x) < 1e-9 ? 1 : sin(M_PI * x) / (M_PI * x);
+      double w = t / half_taps;
+      double window = fabs(w) >= 1 ? 0 : bessel_i0(RESAMPLE_KAISER_BETA * sqrt(1 - w*w)) / window_norm;
+      h[k] = 2 * cutoff * sinc * window;
+      sum += h[k];
+    }
+    // Each phase passes DC at exactly unity gain
+    for (int k = 0; k < num_taps; k++)
+      h[k] /= sum;
+  }
+
+  int num_out = get_resampled_length(num_frames, from_rate, to_rate);
+  for (int n = 0; n < num_out; n++) {
+    long long pos = n * down;
+    long long first = pos / up - half_taps + 1;
+    int phase = (pos % up) * num_phases / up;
+    const float *h = filter + (size_t)phase * num_taps;
+    float y = 0;
+    if (first >= 0 && first + num_taps <= num_frames) {
+      const float *x = in + first;
+      for (int k = 0; k < num_taps; k++)
+	y += x[k] * h[k];
+    }
+    else {
+      // Past either end the input is taken to be silent
+      for (int k = 0; k < num_taps; k++) {
+	long long i = first + k;
+	if (i >= 0 && i < num_frames)
+	  y += in[i] * h[k];
+      }
+    }
+    out[n] = y;
+  }
+  free(filter);
+}
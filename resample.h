@@ -0,0 +1,25 @@
+#ifndef _RESAMPLE
+#define _RESAMPLE
+
+#include <math.h>
+#include <stdlib.h>
+
+// Zero crossings of the windowed sinc on each side, when upsampling. When
+// downsampling the filter is widened in proportion.
+#define RESAMPLE_HALF_TAPS 16
+// Phases of the polyphase filter are kept up to this many; ratios that would
+// need more use the nearest phase below
+#define RESAMPLE_MAX_PHASES 1024
+// Cutoff as a proportion of the lower of the two Nyquist frequencies
+#define RESAMPLE_ROLLOFF 0.95
+#define RESAMPLE_KAISER_BETA 8.0
+// Part of the disk cache key, to be bumped whenever the output changes
+#define RESAMPLE_VERSION 1
+
+/* Number of frames num_frames at from_rate become at to_rate */
+int get_resampled_length(int num_frames, int from_rate, int to_rate);
+/* Converts mono audio between sample rates with a polyphase windowed-sinc
+   filter. out must hold get_resampled_length() frames. */
+void resample(const float *in, int num_frames, int from_rate, float *out, int to_rate);
+
+#endif
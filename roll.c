@@ -0,0 +1,106 @@
+#include "roll.h"
+
+// Frames kept, a power of two no smaller than ROLL_WIDTH
+#define ROLL_RING_SIZE 1024
+#define ROLL_PITCH_HEIGHT (ROLL_HEIGHT - ROLL_VOLUME_HEIGHT)
+
+static RollFrame frames[ROLL_RING_SIZE];
+static unsigned num_recorded = 0;
+static unsigned num_drawn = 0;
+static RenderTexture2D texture;
+static bool has_texture = false;
+
+static int16_t get_cents(float freq) {
+  float cents = 6900 + 1200 * log2f(freq / 440);
+  return fminf(fmaxf(cents, INT16_MIN), INT16_MAX);
+}
+
+void record_roll_frame() {
+  RollFrame *frame = &frames[num_recorded % ROLL_RING_SIZE];
+  float *freqs = get_cur_actual_freqs();
+  frame->num_notes = 0;
+  for (int note = 0; note < NOTETABLE_SIZE && frame->num_notes < ROLL_MAX_NOTES; note++) {
+    if (voices.vols[note] <= 0 || freqs[note] <= 0)
+      continue;
+    int octave = voices.note_states[note] == STILLRELEASED ? voices.octaves_on_release[note] : get_cur_actual_octave();
+    RollNote *roll_note = &frame->notes[frame->num_notes++];
+    roll_note->cents = get_cents(freqs[note]);
+    roll_note->nominal_cents = get_cents(get_note_freq(note-1, octave));
+    roll_note->vol = fminf(voices.vols[note], 1) * 255;
+    roll_note->is_onset = voices.note_states[note] == PRESSED;
+  }
+  num_recorded++;
+}
+
+static int get_roll_y(int cents) {
+  float y = ROLL_PITCH_HEIGHT * (1 - (cents - 100*ROLL_LOWEST_KEY) / (100.0f * (ROLL_HIGHEST_KEY - ROLL_LOWEST_KEY)));
+  return fminf(fmaxf(y, 1), ROLL_PITCH_HEIGHT - 2);
+}
+
+// Colours are kept opaque, so that the texture can be drawn as it is
+static Color fade_from_background(Color color, float amount) {
+  Color background = ROLL_BACKGROUND_COLOR;
+  return (Color){background.r + (color.r - background.r) * amount, background.g + (color.g - background.g) * amount,
+		 background.b + (color.b - background.b) * amount, 255};
+}
+
+static void draw_roll_column(const RollFrame *frame, int x) {
+  DrawRectangle(x, 0, 1, ROLL_HEIGHT, ROLL_BACKGROUND_COLOR);
+  for (int key = ROLL_LOWEST_KEY; key <= ROLL_HIGHEST_KEY; key += 12)
+    DrawRectangle(x, get_roll_y(100*key), 1, 1, fade_from_background(WHITE, 0.15));
+  DrawRectangle(x, ROLL_PITCH_HEIGHT, 1, 1, fade_from_background(WHITE, 0.3));
+
+  float max_vol = 0;
+  for (int i = 0; i < frame->num_notes; i++) {
+    if (frame->notes[i].is_onset)
+      DrawRectangle(x, 0, 1, ROLL_PITCH_HEIGHT, fade_from_background(WHITE, 0.25));
+  }
+  for (int i = 0; i < frame->num_notes; i++) {
+    const RollNote *note = &frame->notes[i];
+    float vol = note->vol / 255.0f;
+    DrawRectangle(x, get_roll_y(note->nominal_cents), 1, 2, fade_from_background(WHITE, 0.3));
+    DrawRectangle(x, get_roll_y(note->cents) - 1, 1, 3, fade_from_background(WHITE, 0.4 + 0.6*vol));
+    max_vol = fmaxf(max_vol, vol);
+  }
+  int height = max_vol * (ROLL_VOLUME_HEIGHT - 2);
+  if (height > 0)
+    DrawRectangle(x, ROLL_HEIGHT - height, 1, height, fade_from_background(WHITE, 0.6));
+}
+
+void update_roll_texture() {
+  if (!has_texture) {
+    texture = LoadRenderTexture(ROLL_WIDTH, ROLL_HEIGHT);
+    has_texture = true;
+    BeginTextureMode(texture);
+    ClearBackground(ROLL_BACKGROUND_COLOR);
+    EndTextureMode();
+  }
+  if (num_recorded - num_drawn > ROLL_WIDTH)
+    num_drawn = num_recorded - ROLL_WIDTH;
+  if (num_drawn == num_recorded)
+    return;
+
+  BeginTextureMode(texture);
+  for (; num_drawn != num_recorded; num_drawn++)
+    draw_roll_column(&frames[num_drawn % ROLL_RING_SIZE], num_drawn % ROLL_WIDTH);
+  EndTextureMode();
+}
+
+void draw_roll(int x, int y) {
+  if (!has_texture)
+    return;
+  // The oldest column is the next to be drawn over. Render textures are upside
+  // down, hence the negative heights.
+  int oldest = num_drawn % ROLL_WIDTH;
+  DrawRectangle(x + 3, y + 2, ROLL_WIDTH, ROLL_HEIGHT, BLACK);
+  DrawTextureRec(texture.texture, (Rectangle){oldest, 0, ROLL_WIDTH - oldest, -ROLL_HEIGHT}, (Vector2){x, y}, WHITE);
+  if (oldest > 0)
+    DrawTextureRec(texture.texture, (Rectangle){0, 0, oldest, -ROLL_HEIGHT}, (Vector2){x + ROLL_WIDTH - oldest, y}, WHITE);
+}
+
+void cleanup_roll() {
+  if (has_texture) {
+    UnloadRenderTexture(texture);
+    has_texture = false;
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef _ROLL
+#define _ROLL
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "raylib.h"
+#include "globals.h"
+#include "voice.h"
+#include "freq.h"
+#include "octave.h"
+
+// One column per frame, so the roll covers ROLL_WIDTH/FPS seconds
+#define ROLL_WIDTH 600
+#define ROLL_HEIGHT 110
+// The volume lane along the bottom; pitches are shown above it
+#define ROLL_VOLUME_HEIGHT 14
+// Range of pitches shown, as MIDI key numbers (C2 to C6). Anything outside is
+// drawn at the edge.
+#define ROLL_LOWEST_KEY 36
+#define ROLL_HIGHEST_KEY 84
+// At most this many notes are recorded per frame, as in the chord display
+#define ROLL_MAX_NOTES 6
+#define ROLL_BACKGROUND_COLOR (Color){48,62,56,255}
+
+/* A piano roll of the last few seconds of play. Each frame, record_roll_frame()
+ * stores the notes sounding, with their pitch including every modifier, the
+ * pitch they would have without them, their volume and whether they started
+ * that frame. When drawn, only the frames recorded since the last draw are
+ * added to a render texture used as a ring of columns, which is then shown
+ * starting from its oldest column. */
+
+typedef struct {
+  int16_t cents;  // Above MIDI key 0
+  int16_t nominal_cents;  // Without pitch modifiers
+  uint8_t vol;  // 255 is full volume
+  uint8_t is_onset;
+} RollNote;
+
+typedef struct {
+  uint8_t num_notes;
+  RollNote notes[ROLL_MAX_NOTES];
+} RollFrame;
+
+/* Called once per frame in play mode, after the control-rate updates */
+void record_roll_frame();
+/* Draws the new frames into the texture. Called outside of
+   BeginDrawing()/EndDrawing(). */
+void update_roll_texture();
+void draw_roll(int x, int y);
+/* Called before the window is closed */
+void cleanup_roll();
+
+#endif
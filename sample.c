@@ -1,44 +1,533 @@
 #include "sample.h"
 
-static SamplePlaybackState playback_states[NOTETABLE_SIZE];
+// A decoded sample file, shared by every sample that uses it
+typedef struct CachedSample {
+  char path[MAX_PATH_LEN];  // Canonical
+  FileStamp stamp;
+  int refs;
+  int sample_rate;
+  int num_frames;
+  PcmFormat format;
+  const void *data;
+  int num_loaded_frames;
+  // Only kept open if data points straight into the file, which is only done
+  // for files in the disk cache. Those are written by vibro itself, and
+  // replaced by renaming rather than changed in place, so the mapping can't
+  // fault. (Pinned data from banks is the same, see pack.c.)
+  MappedFile file;
+  // Only set for samples that are streamed, which keep their file open there
+  StreamSource *stream;
+  // Set for data that belongs to someone else (see add_pinned_sample())
+  bool is_pinned;
+  SamplePeaks *peaks;
+} CachedSample;
 
-static void reset_sample_playback_state(int note) {
-  playback_states[note].pitch_modifier = 1;
-  playback_states[note].sample_frame_counter = NIL;
+typedef struct {
+  char name[MAX_STR_LEN];
+  CachedSample *cached;
+} PinnedSample;
+
+// Loader threads add to the cache while the main thread releases from it
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CachedSample **cache;
+// Kept apart from cache, as they aren't looked up by file. Each holds a
+// reference of its own until remove_pinned_samples().
+static PinnedSample *pinned_samples;
+static bool is_compact_storage = true;
+// Size of all the data in cache, in bytes
+static size_t cache_size = 0;
+// Where files converted to SAMPLE_RATE are kept between runs. Empty if there
+// is nowhere to keep them.
+static char disk_cache_dir[MAX_PATH_LEN] = "";
+
+// Must be called with cache_mutex held
+static CachedSample *find_cached_sample(const char *path, const FileStamp *stamp) {
+  for (int i = 0; i < (int)arrlenu(cache); i++) {
+    if (strcmp(cache[i]->path, path) == 0 && is_same_file_stamp(&cache[i]->stamp, stamp))
+      return cache[i];
+  }
+  return NULL;
+}
+
+// Must be called with cache_mutex held
+static CachedSample *find_pinned_sample(const char *key) {
+  for (int i = 0; i < (int)arrlenu(pinned_samples); i++) {
+    if (strcmp(pinned_samples[i].cached->path, key) == 0)
+      return pinned_samples[i].cached;
+  }
+  return NULL;
+}
+
+static void free_cached_sample(CachedSample *cached) {
+  if (cached->peaks != NULL) {
+    free(cached->peaks->levels[0]);
+    free(cached->peaks);
+  }
+  if (cached->is_pinned) {
+    free(cached);
+    return;
+  }
+  if (cached->stream != NULL) {
+    fclose(cached->stream->file);
+    free(cached->stream);
+  }
+  if (cached->file.bytes != NULL)
+    unmap_file(&cached->file);
+  else
+    free((void *)cached->data);
+  free(cached);
+}
+
+static int get_stored_frame_size(PcmFormat format) {
+  switch (format) {
+  case PCM_S16: return 2;
+  case PCM_S24: return 3;
+  default: return sizeof(float);
+  }
+}
+
+static size_t get_peaks_size(const SamplePeaks *peaks) {
+  size_t num_blocks = 0;
+  for (int level = 0; peaks != NULL && level < peaks->num_levels; level++)
+    num_blocks += peaks->level_lengths[level];
+  return num_blocks * 2 * sizeof(int16_t);
+}
+
+static size_t get_cached_sample_size(const CachedSample *cached) {
+  // Pinned data is mapped from a file, so the OS can drop it whenever
+  if (cached->is_pinned)
+    return 0;
+  return (size_t)cached->num_loaded_frames * get_stored_frame_size(cached->format) + get_peaks_size(cached->peaks);
+}
+
+static SamplePeaks *build_sample_peaks(PcmFormat format, const void *data, int num_frames) {
+  SamplePeaks *peaks = calloc(1, sizeof(SamplePeaks));
+  size_t num_blocks = 0;
+  int length = (num_frames + PEAK_BASE_FRAMES - 1) / PEAK_BASE_FRAMES;
+  do {
+    peaks->level_lengths[peaks->num_levels++] = length;
+    num_blocks += length;
+    length = (length + 1) / 2;
+  } while (peaks->level_lengths[peaks->num_levels - 1] > 1 && peaks->num_levels < MAX_PEAK_LEVELS);
+  peaks->levels[0] = malloc(num_blocks * 2 * sizeof(int16_t));
+  for (int level = 1; level < peaks->num_levels; level++)
+    peaks->levels[level] = peaks->levels[level - 1] + 2 * peaks->level_lengths[level - 1];
+
+  // The finest level comes from the frames, rounded outwards so that the
+  // peaks never cut into the wave
+  Sample sample = {.format = format, .data = data};
+  float buffer[CONVERT_BLOCK_FRAMES];
+  int16_t *level = peaks->levels[0];
+  for (int first = 0; first < num_frames; first += CONVERT_BLOCK_FRAMES) {
+    int n = min(CONVERT_BLOCK_FRAMES, num_frames - first);
+    const float *frames = get_sample_frames(&sample, first, n, buffer);
+    for (int block = 0; block < n; block += PEAK_BASE_FRAMES) {
+      float low = frames[block], high = frames[block];
+      for (int i = block + 1; i < min(block + PEAK_BASE_FRAMES, n); i++) {
+	low = fminf(low, frames[i]);
+	high = fmaxf(high, frames[i]);
+      }
+      int index = (first + block) / PEAK_BASE_FRAMES;
+      level[2*index] = fclamp(floorf(low * 32767), -32767, 32767);
+      level[2*index + 1] = fclamp(ceilf(high * 32767), -32767, 32767);
+    }
+  }
+  // Each coarser level merges pairs of blocks of the one before
+  for (int l = 1; l < peaks->num_levels; l++) {
+    const int16_t *finer = peaks->levels[l - 1];
+    int16_t *coarser = peaks->levels[l];
+    int finer_length = peaks->level_lengths[l - 1];
+    for (int i = 0; i < peaks->level_lengths[l]; i++) {
+      int j = min(2*i + 1, finer_length - 1);
+      coarser[2*i] = min(finer[4*i], finer[2*j]);
+      coarser[2*i + 1] = finer[4*i + 1] > finer[2*j + 1] ? finer[4*i + 1] : finer[2*j + 1];
+    }
+  }
+  return peaks;
+}
+
+// The converted copy of a file is named after a hash of everything that goes
+// into it, so a changed file, engine rate or resampler never matches
+static bool get_disk_cache_path(const MappedFile *file, PcmFormat format, char *out) {
+  if (disk_cache_dir[0] == '\0')
+    return false;
+  int key[] = {SAMPLE_RATE, format, RESAMPLE_VERSION};
+  uint64_t hash = hash_bytes(FNV_OFFSET_BASIS, file->bytes, file->size);
+  hash = hash_bytes(hash, key, sizeof(key));
+  return snprintf(out, MAX_PATH_LEN, "%s%016llx.wav", disk_cache_dir, (unsigned long long)hash) < MAX_PATH_LEN;
+}
+
+static bool load_disk_cached_sample(CachedSample *cached, const char *cache_path) {
+  MappedFile file;
+  WavInfo wav;
+  if (!map_file(cache_path, &file))
+    return false;
+  if (!parse_wav_header(&file, &wav) || wav.sample_rate != SAMPLE_RATE || wav.num_frames < 2
+      || !is_wav_zero_copy(&wav, cached->format)) {
+    unmap_file(&file);
+    return false;
+  }
+  cached->num_frames = wav.num_frames;
+  cached->num_loaded_frames = wav.num_frames;
+  cached->data = wav.pcm;
+  cached->file = file;
+  return true;
+}
+
+// Converts a file that isn't at SAMPLE_RATE once, here, rather than on every
+// note. The result is written to the disk cache for next time.
+static void load_resampled_sample(CachedSample *cached, const MappedFile *file, const WavInfo *wav) {
+  cached->sample_rate = SAMPLE_RATE;
+  char cache_path[MAX_PATH_LEN];
+  bool has_cache_path = get_disk_cache_path(file, cached->format, cache_path);
+  if (has_cache_path && load_disk_cached_sample(cached, cache_path))
+    return;
+
+  float *decoded = malloc((size_t)wav->num_frames * sizeof(float));
+  decode_wav_frames(wav, 0, wav->num_frames, decoded);
+  int num_frames = get_resampled_length(wav->num_frames, wav->sample_rate, SAMPLE_RATE);
+  float *resampled = malloc((size_t)num_frames * sizeof(float));
+  resample(decoded, wav->num_frames, wav->sample_rate, resampled, SAMPLE_RATE);
+  free(decoded);
+
+  void *data = resampled;
+  if (cached->format == PCM_S16) {
+    int16_t *converted = malloc((size_t)num_frames * sizeof(int16_t));
+    for (int i = 0; i < num_frames; i++)
+      converted[i] = lrintf(fclamp(resampled[i] * 32768.0f, -32768, 32767));
+    free(resampled);
+    data = converted;
+  }
+  if (has_cache_path && !write_wav_file(cache_path, SAMPLE_RATE, cached->format, data, num_frames))
+    TraceLog(LOG_WARNING, "SAMPLE: Could not write %s", cache_path);
+  cached->num_frames = num_frames;
+  cached->num_loaded_frames = num_frames;
+  cached->data = data;
+}
+
+static CachedSample *decode_sample_file(const char *path, const FileStamp *stamp) {
+  MappedFile file;
+  WavInfo wav;
+  if (!map_file(path, &file)) {
+    TraceLog(LOG_WARNING, "SAMPLE: Could not open %s", path);
+    return NULL;
+  }
+  if (!parse_wav_header(&file, &wav) || wav.num_frames < 2) {
+    TraceLog(LOG_WARNING, "SAMPLE: %s is not a .wav file that can be read", path);
+    unmap_file(&file);
+    return NULL;
+  }
+
+  CachedSample *cached = calloc(1, sizeof(CachedSample));
+  strcpy(cached->path, path);
+  cached->stamp = *stamp;
+  cached->refs = 1;
+  cached->sample_rate = wav.sample_rate;
+  cached->num_frames = wav.num_frames;
+  cached->num_loaded_frames = wav.num_frames;
+  cached->format = PCM_F32;
+  FILE *stream_file = NULL;
+  if (is_streaming_enabled() && wav.num_frames > wav.sample_rate * STREAM_MIN_SECONDS)
+    stream_file = fopen(path, "rb");
+  if (stream_file != NULL) {
+    // Only the head is decoded now. Even for float files it is copied out of
+    // the mapping, so that the audio thread never has to wait on the disk.
+    StreamSource *stream = malloc(sizeof(StreamSource));
+    stream->file = stream_file;
+    stream->wav = wav;
+    stream->wav.pcm = NULL;
+    stream->pcm_offset = wav.pcm - file.bytes;
+    stream->num_head_frames = wav.sample_rate * STREAM_HEAD_MS / 1000;
+    float *head = malloc(stream->num_head_frames * sizeof(float));
+    decode_wav_frames(&wav, 0, stream->num_head_frames, head);
+    cached->data = head;
+    cached->num_loaded_frames = stream->num_head_frames;
+    cached->stream = stream;
+    unmap_file(&file);
+  }
+  else if (wav.sample_rate != SAMPLE_RATE) {
+    // Only 16-bit files stay compact once converted; 24-bit ones would lose
+    // too much in 16 bits and can't be resampled in place
+    cached->format = is_compact_storage && wav.format == PCM_S16 ? PCM_S16 : PCM_F32;
+    load_resampled_sample(cached, &file, &wav);
+    unmap_file(&file);
+  }
+  else {
+    // 16- and 24-bit files take half or three quarters of the space kept as
+    // they are, and are converted to float a block at a time when played
+    bool is_compact = is_compact_storage && (wav.format == PCM_S16 || wav.format == PCM_S24);
+    cached->format = is_compact ? wav.format : PCM_F32;
+    // Files already in that format are copied rather than played from the
+    // mapping, as the user may change the file while it is loaded (which is
+    // what reloading changed files is for), and a mapping of a truncated
+    // file faults when read
+    size_t size = (size_t)wav.num_frames * get_stored_frame_size(cached->format);
+    void *data = malloc(size);
+    if (is_wav_zero_copy(&wav, cached->format))
+      memcpy(data, wav.pcm, size);
+    else if (is_compact)
+      decode_wav_frames_native(&wav, 0, wav.num_frames, data);
+    else
+      decode_wav_frames(&wav, 0, wav.num_frames, data);
+    cached->data = data;
+    unmap_file(&file);
+  }
+  cached->peaks = build_sample_peaks(cached->format, cached->data, cached->num_loaded_frames);
+  return cached;
 }
 
-void handle_sample_playback(int note, Sample sample) {
-  float pitch_modifier = sample.pitch_modifier * powf(SEMITONE, note) * get_bend_modifier() * get_gliss_modifier() * get_vib_modifier() * get_dive_modifier();
-  if (is_autoglissing())
-    pitch_modifier = powf(SEMITONE, note) * get_autogliss_modifier();
-  SetSoundPitch(sample.sound, pitch_modifier);
-  playback_states[note].pitch_modifier = pitch_modifier;
+static void release_cached_sample(CachedSample *cached) {
+  bool is_unused = false;
+  pthread_mutex_lock(&cache_mutex);
+  if (--cached->refs == 0) {
+    for (int i = 0; i < (int)arrlenu(cache); i++) {
+      if (cache[i] == cached) {
+	arrdel(cache, i);
+	break;
+      }
+    }
+    cache_size -= get_cached_sample_size(cached);
+    is_unused = true;
+  }
+  pthread_mutex_unlock(&cache_mutex);
+  if (is_unused)
+    free_cached_sample(cached);
+}
 
-  SetSoundVolume(sample.sound, sample.volume_modifier * get_actual_vols()[note]);
+bool load_sample_data(const char *path, Sample *sample, SampleInfo *info) {
+  pthread_mutex_lock(&cache_mutex);
+  CachedSample *cached = find_pinned_sample(path);
+  if (cached != NULL)
+    cached->refs++;
+  pthread_mutex_unlock(&cache_mutex);
 
-  int note_state = get_cur_note_states()[note];
+  char canonical_path[MAX_PATH_LEN];
+  FileStamp stamp;
+  if (cached == NULL && (!get_canonical_path(path, canonical_path, MAX_PATH_LEN) || !get_file_stamp(canonical_path, &stamp))) {
+    TraceLog(LOG_WARNING, "SAMPLE: Could not open %s", path);
+    return false;
+  }
 
-  if (note_state == PRESSED) {
-    playback_states[note].sample_frame_counter = 0;
-    PlaySound(sample.sound);
+  if (cached == NULL) {
+    pthread_mutex_lock(&cache_mutex);
+    cached = find_cached_sample(canonical_path, &stamp);
+    if (cached != NULL)
+      cached->refs++;
+    pthread_mutex_unlock(&cache_mutex);
   }
-  else if (note_state == HELD) {
-    if (IsSoundPlaying(sample.sound))
-      playback_states[note].sample_frame_counter += sample.sample_rate * pitch_modifier / FPS;
-    else if (sample.play_continuously) {
-      playback_states[note].sample_frame_counter = 0;
-      PlaySound(sample.sound);
+
+  if (cached == NULL) {
+    // Decoding is done outside the lock, so another thread may have loaded
+    // the same file in the meantime. In that case its copy wins.
+    CachedSample *decoded = decode_sample_file(canonical_path, &stamp);
+    if (decoded == NULL)
+      return false;
+    pthread_mutex_lock(&cache_mutex);
+    cached = find_cached_sample(canonical_path, &stamp);
+    if (cached != NULL)
+      cached->refs++;
+    else {
+      arrput(cache, decoded);
+      cache_size += get_cached_sample_size(decoded);
     }
+    pthread_mutex_unlock(&cache_mutex);
+    if (cached != NULL)
+      free_cached_sample(decoded);
+    else
+      cached = decoded;
   }
-  else if (note_state == RELEASED && sample.stop_on_release && IsSoundPlaying(sample.sound)) {
-    reset_sample_playback_state(note);
-    StopSound(sample.sound);
+
+  info->cached = cached;
+  sample->sample_rate = cached->sample_rate;
+  sample->num_frames = cached->num_frames;
+  sample->format = cached->format;
+  sample->data = cached->data;
+  sample->num_loaded_frames = cached->num_loaded_frames;
+  sample->stream = cached->stream;
+  sample->peaks = cached->peaks;
+  return true;
+}
+
+void retain_sample_data(SampleInfo *info) {
+  pthread_mutex_lock(&cache_mutex);
+  info->cached->refs++;
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+void unload_sample_data(Sample *sample, SampleInfo *info) {
+  release_cached_sample(info->cached);
+  info->cached = NULL;
+  sample->data = NULL;
+  sample->stream = NULL;
+  sample->peaks = NULL;
+  sample->is_ready = false;
+}
+
+void add_pinned_sample(const char *name, const char *key, int sample_rate, int num_frames, PcmFormat format, const void *data) {
+  CachedSample *cached = calloc(1, sizeof(CachedSample));
+  strncpy(cached->path, key, MAX_PATH_LEN-1);
+  cached->refs = 1;
+  cached->sample_rate = sample_rate;
+  cached->num_frames = num_frames;
+  cached->format = format;
+  cached->data = data;
+  cached->num_loaded_frames = num_frames;
+  cached->is_pinned = true;
+  PinnedSample pinned = {.cached = cached};
+  strncpy(pinned.name, name, MAX_STR_LEN-1);
+  pthread_mutex_lock(&cache_mutex);
+  arrput(pinned_samples, pinned);
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+void remove_pinned_samples() {
+  pthread_mutex_lock(&cache_mutex);
+  PinnedSample *removed = pinned_samples;
+  pinned_samples = NULL;
+  pthread_mutex_unlock(&cache_mutex);
+  for (int i = 0; i < (int)arrlenu(removed); i++)
+    release_cached_sample(removed[i].cached);
+  arrfree(removed);
+}
+
+size_t get_unshared_sample_size(const SampleInfo *infos, int n) {
+  size_t size = 0;
+  pthread_mutex_lock(&cache_mutex);
+  for (int i = 0; i < n; i++) {
+    CachedSample *cached = infos[i].cached;
+    if (cached == NULL)
+      continue;
+    // Each file is counted at its first reference in infos, and only if every
+    // reference to it is in infos
+    bool is_first = true;
+    int num_refs = 0;
+    for (int j = 0; j < n; j++) {
+      if (infos[j].cached == cached) {
+	is_first = is_first && j >= i;
+	num_refs++;
+      }
+    }
+    if (is_first && num_refs == cached->refs)
+      size += get_cached_sample_size(cached);
   }
+  pthread_mutex_unlock(&cache_mutex);
+  return size;
+}
+
+void init_sample_disk_cache() {
+  const char *dir = TextFormat("%scache/", GetApplicationDirectory());
+  if (strlen(dir) < MAX_PATH_LEN - 32 && make_directory(dir))
+    strcpy(disk_cache_dir, dir);
+  else
+    TraceLog(LOG_WARNING, "SAMPLE: Could not create %s, converted samples won't be kept", dir);
+}
+
+const char *get_sample_disk_cache_dir() {
+  return disk_cache_dir;
+}
 
-  if ((note_state == RELEASED || note_state == STILLRELEASED) && !sample.stop_on_release)
-    playback_states[note].sample_frame_counter += sample.sample_rate * pitch_modifier / FPS;
+void set_compact_sample_storage(bool is_compact) {
+  is_compact_storage = is_compact;
 }
 
-SamplePlaybackState *get_sample_playback_states() {
-  return playback_states;
-}
\ No newline at end of file
+const float *get_sample_frames(const Sample *sample, int first_frame, int num_frames, float *buffer) {
+  switch (sample->format) {
+  case PCM_S16:
+    convert_s16_to_f32((const int16_t *)sample->data + first_frame, num_frames, buffer);
+    return buffer;
+  case PCM_S24:
+    convert_s24_to_f32((const unsigned char *)sample->data + 3*first_frame, num_frames, buffer);
+    return buffer;
+  default:
+    return (const float *)sample->data + first_frame;
+  }
+}
+
+float get_sample_frame(const Sample *sample, int frame) {
+  float x;
+  return *get_sample_frames(sample, frame, 1, &x);
+}
+
+void get_sample_peaks(const Sample *sample, double first_frame, double frames_per_column, int num_columns, float *lows, float *highs) {
+  const SamplePeaks *peaks = sample->peaks;
+  int num_frames = sample->num_loaded_frames;
+  // The coarsest level with at least one block per column
+  int level = NIL;
+  if (peaks != NULL && frames_per_column >= PEAK_BASE_FRAMES)
+    level = min((int)log2(frames_per_column / PEAK_BASE_FRAMES), peaks->num_levels - 1);
+
+  float buffer[CONVERT_BLOCK_FRAMES];
+  for (int i = 0; i < num_columns; i++) {
+    // Each column includes the first frame of the next, so that they join up
+    long long first = first_frame + i * frames_per_column;
+    long long last = min((long long)ceil(first_frame + (i+1) * frames_per_column), (long long)num_frames - 1);
+    if (first < 0)
+      first = 0;
+    if (first > last) {
+      lows[i] = highs[i] = 0;
+      continue;
+    }
+
+    float low = 1, high = -1;
+    if (level != NIL) {
+      int block_frames = PEAK_BASE_FRAMES << level;
+      const int16_t *blocks = peaks->levels[level];
+      for (long long block = first / block_frames; block <= last / block_frames; block++) {
+	low = fminf(low, blocks[2*block] / 32767.0f);
+	high = fmaxf(high, blocks[2*block + 1] / 32767.0f);
+      }
+    }
+    else {
+      for (long long frame = first; frame <= last; frame += CONVERT_BLOCK_FRAMES) {
+	int n = min((long long)CONVERT_BLOCK_FRAMES, last - frame + 1);
+	const float *frames = get_sample_frames(sample, frame, n, buffer);
+	for (int j = 0; j < n; j++) {
+	  low = fminf(low, frames[j]);
+	  high = fmaxf(high, frames[j]);
+	}
+      }
+    }
+    lows[i] = low;
+    highs[i] = high;
+  }
+}
+
+size_t get_sample_cache_size() {
+  pthread_mutex_lock(&cache_mutex);
+  size_t size = cache_size;
+  pthread_mutex_unlock(&cache_mutex);
+  return size;
+}
+
+bool is_sample_file_unchanged(const SampleInfo *info, const char *path) {
+  char canonical_path[MAX_PATH_LEN];
+  FileStamp stamp;
+  if (info->cached == NULL)
+    return false;
+  if (info->cached->is_pinned)
+    return strcmp(info->cached->path, path) == 0;
+  if (!get_canonical_path(path, canonical_path, MAX_PATH_LEN) || !get_file_stamp(canonical_path, &stamp))
+    return false;
+  return strcmp(info->cached->path, canonical_path) == 0 && is_same_file_stamp(&info->cached->stamp, &stamp);
+}
+
+const char *get_sample_file_path(const char *name) {
+  // Pinned samples are only ever added and removed by the main thread
+  for (int i = 0; i < (int)arrlenu(pinned_samples); i++) {
+    if (strcmp(pinned_samples[i].name, name) == 0)
+      return pinned_samples[i].cached->path;
+  }
+  return TextFormat("%ssamples/%s", GetApplicationDirectory(), name);
+}
+
+void get_sample_pitches(const Sample *samples, float *pitches) {
+  float modifier = get_bend_modifier() * get_gliss_modifier() * get_dive_modifier();
+  // Each note plays at its ratio to the first note in the tuning, taken in the
+  // octave of C4 (as the table is indexed like get_note_freq(), the first note
+  // is -1). If the first note isn't mapped, its 12-TET pitch is used instead.
+  float reference = get_note_freq(-1, 0);
+  if (reference == 0)
+    reference = C4 / SEMITONE;
+  for (int note = 0; note < NOTETABLE_SIZE; note++)
+    pitches[note] = samples[note].pitch_modifier * get_note_freq(note-1, 0) / reference * modifier;
+}
@@ -1,19 +1,93 @@
 #ifndef _SAMPLE
 #define _SAMPLE
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
 #include "raylib.h"
 #include "note.h"
 #include "freq.h"
-#include "volume.h"
 #include "instrument.h"
+#include "wav.h"
+#include "stream.h"
+#include "resample.h"
+#include "stb_ds.h"
 
-/** For displaying the sample waveform while playing back a sample **/
-typedef struct {
-  int sample_frame_counter;
-  float pitch_modifier;
-} SamplePlaybackState;
+// How loud samples are relative to the output range of write_audio_samples().
+// Samples used to be played by raylib at full scale, which corresponds to an
+// amplitude of 0.5 there.
+#define SAMPLE_GAIN 0.5
+#define MAX_PATH_LEN 512
+// Frames of a sample converted to float at once while mixing
+#define CONVERT_BLOCK_FRAMES 256
+// Frames summarised by each entry of the finest level of a peak pyramid
+#define PEAK_BASE_FRAMES 16
+#define MAX_PEAK_LEVELS 24
 
-void handle_sample_playback(int note, Sample sample);
-SamplePlaybackState *get_sample_playback_states();
+/* A min/max summary of the loaded frames of a sample at successively halved
+ * resolutions, built when it is loaded. Level l holds, for each block of
+ * PEAK_BASE_FRAMES << l frames, the lowest and highest value in it as a pair
+ * of 16-bit values. All levels are in one allocation starting at levels[0]. */
+typedef struct SamplePeaks {
+  int num_levels;
+  int level_lengths[MAX_PEAK_LEVELS];  // In blocks
+  int16_t *levels[MAX_PEAK_LEVELS];
+} SamplePeaks;
+
+/* Load the .wav file at path into sample. Decoded files are kept in a cache
+   shared by all instruments, keyed by canonical path, size and modification
+   time, so a file used by several samples is decoded and stored once. Each
+   loaded sample holds a reference, which is dropped by unload_sample_data().
+   Long files are streamed (see stream.h) apart from their first few hundred
+   ms. Other files not at SAMPLE_RATE are resampled to it, and the result is
+   kept in the disk cache, to be used straight from a memory mapping next
+   time. Files the user can change are always copied out of their mapping. Returns false if the file
+   can't be loaded. Safe to call from any thread. */
+bool load_sample_data(const char *path, Sample *sample, SampleInfo *info);
+/* Set up the directory converted samples are kept in. Called once from the
+   main thread before any samples are loaded. */
+void init_sample_disk_cache();
+/* Empty if there is no disk cache */
+const char *get_sample_disk_cache_dir();
+/* Take another reference to the data of a loaded sample, for a copy of it */
+void retain_sample_data(SampleInfo *info);
+void unload_sample_data(Sample *sample, SampleInfo *info);
+/* Whether 16- and 24-bit files are kept in their own format rather than
+   converted to float. Only affects files loaded afterwards. */
+void set_compact_sample_storage(bool is_compact);
+/* Frames of a loaded sample as float. Float samples are returned in place;
+   others are converted into buffer, which must hold num_frames frames. */
+const float *get_sample_frames(const Sample *sample, int first_frame, int num_frames, float *buffer);
+float get_sample_frame(const Sample *sample, int frame);
+/* Fill lows and highs with the lowest and highest value of a loaded sample
+   within each of num_columns stretches of frames_per_column frames, starting
+   from first_frame. Reads the level of the peak pyramid that matches the
+   stretch, or the frames themselves when zoomed in further than the pyramid
+   goes. Anything past the loaded frames reads as silence. */
+void get_sample_peaks(const Sample *sample, double first_frame, double frames_per_column, int num_columns, float *lows, float *highs);
+/* Bytes of sample data currently loaded, counting shared files once */
+size_t get_sample_cache_size();
+/* Whether the file at path is still the one info was loaded from */
+bool is_sample_file_unchanged(const SampleInfo *info, const char *path);
+/* Make data that is already in memory, such as a sample bank mapped by
+   load_sample_bank(), available to samples with the path name. Loading the
+   sample then takes a reference to data directly; key is what
+   get_sample_file_path() gives for name, and must be unique. The data must
+   stay valid until remove_pinned_samples() and every sample using it has been
+   unloaded. Only called from the main thread. */
+void add_pinned_sample(const char *name, const char *key, int sample_rate, int num_frames, PcmFormat format, const void *data);
+void remove_pinned_samples();
+/* Bytes that unloading the n samples of infos would free: the data that
+   nothing but infos holds a reference to. Pinned data takes up no space in
+   the memory budget, so it counts for nothing. */
+size_t get_unshared_sample_size(const SampleInfo *infos, int n);
+/* Where the sample with the given path (as entered in instrument mode) is on
+   disk, or the key of the pinned sample of that name if there is one. Uses
+   TextFormat(), so only call this from the main thread. */
+const char *get_sample_file_path(const char *name);
+/* Fill pitches with the playback speed of each note of a sample instrument,
+   accounting for the tuning and pitch modifiers except vibrato and
+   autogliss. */
+void get_sample_pitches(const Sample *samples, float *pitches);
 
 #endif
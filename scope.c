@@ -0,0 +1,56 @@
+#include "scope.h"
+
+#define RING_MASK (SCOPE_RING_SIZE - 1)
+
+static float ring[SCOPE_RING_SIZE];
+// Frames written so far
+static atomic_ullong write_pos = 0;
+
+void write_scope_frames(const float *frames, unsigned int n) {
+  unsigned long long pos = atomic_load_explicit(&write_pos, memory_order_relaxed);
+  for (unsigned int i = 0; i < n; i++)
+    ring[(pos + i) & RING_MASK] = frames[i];
+  atomic_store_explicit(&write_pos, pos + n, memory_order_release);
+}
+
+bool read_scope_frames(float *out, int n) {
+  // The audio thread may write over the frames while they are copied. It is
+  // far from lapping the reader in practice, but if it does, try again.
+  for (int attempt = 0; attempt < 3; attempt++) {
+    unsigned long long end = atomic_load_explicit(&write_pos, memory_order_acquire);
+    if (end < (unsigned long long)n)
+      return false;
+    unsigned long long start = end - n;
+    int first = start & RING_MASK;
+    int num_before_wrap = n < SCOPE_RING_SIZE - first ? n : SCOPE_RING_SIZE - first;
+    memcpy(out, ring + first, num_before_wrap * sizeof(float));
+    memcpy(out + num_before_wrap, ring, (n - num_before_wrap) * sizeof(float));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&write_pos, memory_order_relaxed) - start <= SCOPE_RING_SIZE)
+      return true;
+  }
+  return false;
+}
+
+int find_scope_trigger(const float *frames, int num_frames, int display_frames) {
+  int latest = num_frames - display_frames;
+  float peak = 0;
+  for (int i = 0; i < num_frames; i++)
+    peak = fmaxf(peak, fabsf(frames[i]));
+  if (peak == 0)
+    return latest;
+
+  // The last crossing that leaves room for display_frames after it
+  float arm_level = -SCOPE_HYSTERESIS * peak;
+  bool is_armed = false;
+  int trigger = latest;
+  for (int i = 0; i <= latest; i++) {
+    if (frames[i] < arm_level)
+      is_armed = true;
+    else if (is_armed && frames[i] >= 0) {
+      trigger = i;
+      is_armed = false;
+    }
+  }
+  return trigger;
+}
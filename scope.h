@@ -0,0 +1,31 @@
+#ifndef _SCOPE
+#define _SCOPE
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <math.h>
+#include <string.h>
+
+// Frames of audio output kept for the scope. Must be a power of two.
+#define SCOPE_RING_SIZE 65536
+// Proportion of the peak the signal has to fall below before a rising zero
+// crossing counts as a trigger, so that noise around zero doesn't trigger
+#define SCOPE_HYSTERESIS 0.1
+
+/* The audio callback copies everything it outputs into a ring buffer, which
+ * the GUI reads the latest frames of to draw the wave. Neither side ever
+ * waits on the other. */
+
+/** Called by the audio thread only **/
+void write_scope_frames(const float *frames, unsigned int n);
+
+/* Copy the n most recent frames of output into out, oldest first. Returns
+   false if fewer than n frames have been output so far. n must be at most
+   SCOPE_RING_SIZE/2. */
+bool read_scope_frames(float *out, int n);
+/* Where to start drawing display_frames of the num_frames in frames, so that
+   the wave starts at a rising zero crossing and stays put from one frame to
+   the next. Falls back to the latest frames if there is no crossing. */
+int find_scope_trigger(const float *frames, int num_frames, int display_frames);
+
+#endif
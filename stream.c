@@ -0,0 +1,185 @@
+#include "stream.h"
+
+#define RING_MASK (STREAM_RING_SIZE - 1)
+
+// One per voice. The audio thread says what to stream and how far it has
+// read; the reader thread decodes ahead of that into buffer.
+typedef struct {
+  /** Written by the audio thread **/
+  _Atomic(const StreamSource *) source;
+  atomic_bool loop;
+  atomic_long from_frame;
+  atomic_long read_frame;
+  // Incremented whenever the stream is started or stopped, so that the reader
+  // thread knows to start over
+  atomic_uint generation;
+
+  /** Written by the reader thread **/
+  // The generation the buffer was filled for (top 24 bits), and the frame up
+  // to which it has been filled (bottom 40 bits)
+  atomic_ullong filled;
+  unsigned cur_generation;
+  long write_frame;
+  float *buffer;
+} StreamRing;
+
+static StreamRing rings[NOTETABLE_SIZE];
+static pthread_t reader;
+static bool is_reader_running = false;
+static atomic_bool should_quit = false;
+static atomic_uint num_passes = 0;
+static atomic_int num_underruns = 0;
+// Bytes read from a file before they are decoded. Only used by the reader
+// thread.
+static unsigned char *read_buffer = NULL;
+static size_t read_buffer_size = 0;
+
+static unsigned long long pack_filled(unsigned generation, long end) {
+  return ((unsigned long long)(generation & 0xFFFFFF) << 40) | (unsigned long long)end;
+}
+
+// Decodes n frames from first_frame on into out. Frames past the end of a
+// file that has been cut short since it was opened are silent.
+static void read_stream_frames(const StreamSource *source, long first_frame, long n, float *out) {
+  size_t size = (size_t)n * source->wav.bytes_per_frame;
+  if (size > read_buffer_size) {
+    free(read_buffer);
+    read_buffer = malloc(size);
+    read_buffer_size = size;
+  }
+  long long offset = source->pcm_offset + (long long)first_frame * source->wav.bytes_per_frame;
+  long num_read = read_file_at(source->file, offset, read_buffer, size) / source->wav.bytes_per_frame;
+  WavInfo wav = source->wav;
+  wav.pcm = read_buffer;
+  decode_wav_frames(&wav, 0, num_read, out);
+  memset(out + num_read, 0, (n - num_read) * sizeof(float));
+}
+
+// Returns false if the ring has nothing to stream
+static bool fill_ring(StreamRing *ring) {
+  unsigned generation = atomic_load(&ring->generation);
+  const StreamSource *source = atomic_load(&ring->source);
+  if (source == NULL)
+    return false;
+  if (generation != ring->cur_generation) {
+    ring->cur_generation = generation;
+    long from_frame = atomic_load(&ring->from_frame);
+    ring->write_frame = from_frame > source->num_head_frames ? from_frame : source->num_head_frames;
+  }
+
+  bool loop = atomic_load(&ring->loop);
+  int num_frames = source->wav.num_frames;
+  // The frame before read_frame may still be interpolated from
+  long limit = atomic_load(&ring->read_frame) - 1 + STREAM_RING_SIZE;
+  limit = min(limit, ring->write_frame + STREAM_CHUNK_FRAMES);
+  if (!loop)
+    limit = min(limit, num_frames);
+  // Looping goes back to the start at the last frame (see render_sample())
+  long loop_length = num_frames - 1;
+
+  long write_frame = ring->write_frame;
+  while (write_frame < limit) {
+    long file_frame = loop ? write_frame % loop_length : write_frame;
+    long n = limit - write_frame;
+    n = min(n, STREAM_RING_SIZE - (write_frame & RING_MASK));
+    n = min(n, (loop ? loop_length : num_frames) - file_frame);
+    read_stream_frames(source, file_frame, n, ring->buffer + (write_frame & RING_MASK));
+    write_frame += n;
+  }
+  ring->write_frame = write_frame;
+  atomic_store(&ring->filled, pack_filled(generation, write_frame));
+  return true;
+}
+
+static void *reader_thread(void *arg) {
+  (void)arg;
+  struct timespec poll_interval = {0, STREAM_POLL_NS};
+  struct timespec idle_poll_interval = {0, STREAM_IDLE_POLL_NS};
+  while (!atomic_load(&should_quit)) {
+    bool is_streaming = false;
+    for (int note = 0; note < NOTETABLE_SIZE; note++)
+      is_streaming = fill_ring(&rings[note]) || is_streaming;
+    atomic_fetch_add(&num_passes, 1);
+    nanosleep(is_streaming ? &poll_interval : &idle_poll_interval, NULL);
+  }
+  return NULL;
+}
+
+bool init_streaming() {
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    rings[note].buffer = calloc(STREAM_RING_SIZE, sizeof(float));
+    rings[note].cur_generation = 0;
+    rings[note].write_frame = 0;
+  }
+  is_reader_running = pthread_create(&reader, NULL, reader_thread, NULL) == 0;
+  if (!is_reader_running)
+    TraceLog(LOG_WARNING, "STREAM: Could not start reader thread, long samples will be loaded whole");
+  return is_reader_running;
+}
+
+void cleanup_streaming() {
+  if (is_reader_running) {
+    atomic_store(&should_quit, true);
+    pthread_join(reader, NULL);
+    is_reader_running = false;
+  }
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    free(rings[note].buffer);
+    rings[note].buffer = NULL;
+  }
+  free(read_buffer);
+  read_buffer = NULL;
+  read_buffer_size = 0;
+}
+
+bool is_streaming_enabled() {
+  return is_reader_running;
+}
+
+void start_stream(int note, const StreamSource *source, bool loop, long from_frame) {
+  StreamRing *ring = &rings[note];
+  atomic_store(&ring->source, source);
+  atomic_store(&ring->loop, loop);
+  atomic_store(&ring->from_frame, from_frame);
+  atomic_store(&ring->read_frame, from_frame);
+  atomic_fetch_add(&ring->generation, 1);
+}
+
+void stop_stream(int note) {
+  StreamRing *ring = &rings[note];
+  if (atomic_load(&ring->source) == NULL)
+    return;
+  atomic_store(&ring->source, NULL);
+  atomic_fetch_add(&ring->generation, 1);
+}
+
+const StreamSource *get_stream_source(int note) {
+  return atomic_load(&rings[note].source);
+}
+
+StreamWindow get_stream_window(int note) {
+  StreamRing *ring = &rings[note];
+  unsigned generation = atomic_load(&ring->generation);
+  unsigned long long filled = atomic_load(&ring->filled);
+  StreamWindow window = {.buffer = ring->buffer, .end = 0};
+  // Anything filled for an earlier start of the stream is of no use
+  if ((filled >> 40) == (generation & 0xFFFFFF))
+    window.end = filled & ((1ULL << 40) - 1);
+  return window;
+}
+
+void set_stream_read_frame(int note, long frame) {
+  atomic_store(&rings[note].read_frame, frame);
+}
+
+void count_stream_underrun() {
+  atomic_fetch_add(&num_underruns, 1);
+}
+
+unsigned get_num_stream_passes() {
+  return atomic_load(&num_passes);
+}
+
+int get_num_stream_underruns() {
+  return atomic_load(&num_underruns);
+}
@@ -0,0 +1,69 @@
+#ifndef _STREAM
+#define _STREAM
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "raylib.h"
+#include "globals.h"
+#include "util.h"
+#include "voice.h"
+#include "wav.h"
+
+// Samples longer than this are streamed from disk rather than decoded whole
+#define STREAM_MIN_SECONDS 10
+// How much of a streamed sample is decoded up front, so that notes can start
+// before the reader thread has caught up
+#define STREAM_HEAD_MS 500
+// Frames of each voice's ring buffer. Must be a power of two.
+#define STREAM_RING_SIZE 65536
+// Most frames the reader thread decodes for one voice in one pass
+#define STREAM_CHUNK_FRAMES 8192
+#define STREAM_POLL_NS 1000000
+// While no voice is streaming, the reader thread only checks for new streams
+// at IDLE_FPS. The head of each sample covers the wait until it notices one.
+#define STREAM_IDLE_POLL_NS (1000000000 / IDLE_FPS)
+
+/* Where a streamed sample comes from. The head of the sample is decoded into
+ * Sample.data as usual; the rest is read from the file and decoded as it is
+ * played. The file is read rather than mapped, since it belongs to the user
+ * and may be truncated or rewritten while it is open: a mapping would then
+ * fault, while a read only comes up short (and is played as silence). */
+typedef struct StreamSource {
+  FILE *file;
+  WavInfo wav;  // pcm isn't set, as the file isn't mapped
+  long long pcm_offset;
+  int num_head_frames;
+} StreamSource;
+
+/* What the audio thread can read of a voice's stream in the current block.
+ * Frame f (counted from the start of the sample, and carrying on past its end
+ * when looping) is at buffer[f & (STREAM_RING_SIZE-1)], for f < end. */
+typedef struct {
+  const float *buffer;
+  long end;
+} StreamWindow;
+
+bool init_streaming();
+void cleanup_streaming();
+bool is_streaming_enabled();
+
+/** Called by the audio thread only **/
+/* Start streaming source into the voice of note, from from_frame onwards */
+void start_stream(int note, const StreamSource *source, bool loop, long from_frame);
+void stop_stream(int note);
+const StreamSource *get_stream_source(int note);
+StreamWindow get_stream_window(int note);
+/* Let the reader thread reuse the space before frame */
+void set_stream_read_frame(int note, long frame);
+void count_stream_underrun();
+
+/* Passes the reader thread has made over all the voices. A source that no
+   voice has referred to since the count was taken is safe to free once the
+   count has gone up by two. */
+unsigned get_num_stream_passes();
+int get_num_stream_underruns();
+
+#endif
@@ -2,7 +2,14 @@
 // Defines sin_table
 #include "sin_table.txt"
 
-static float cur_phases[NOTETABLE_SIZE] = {0};
+// Number of the last autogliss started (see get_new_autogliss())
+static unsigned autogliss_seq = 0;
+// Audio blocks finished so far (see get_num_audio_blocks())
+static atomic_uint num_audio_blocks = 0;
+// State of the sample-rate vibrato LFO
+static float vib_sin = 0;
+static float vib_cos = 1;
+static float vib_log_depth = 0;
 
 float pulse(float phase, float pulse_width) {
   return phase >= pulse_width ? -1 : 1;
@@ -37,35 +44,291 @@ float sine(float phase, float *sine_coeffs) {
   return output / amplitude;
 }
 
-float get_amplitude(float *phases) {
-  if (get_num_instruments() == 0)
-    return 0;
+static float oscillate(Instrument *instrument, float phase) {
+  switch (instrument->type) {
+  case PULSE: return pulse(phase, instrument->pulse_width);
+  case TRI: return tri(phase, instrument->tri_nes_style);
+  case SAW: return saw(phase, instrument->saw_nes_style);
+  case SINE: return sine(phase, instrument->sine_coeffs);
+  case SAMPLE: case MULTISAMPLE: return 0;
+  }
+  return 0;
+}
+
+// Produces the vibrato frequency ratio for every frame of the block into vibs.
+// The LFO is kept as a rotating (sin, cos) pair so that each frame costs a few
+// multiply-adds, and its depth is ramped linearly from the previous block.
+static void render_vibrato(float *vibs, unsigned int frames) {
+  float target_log_depth = get_vib_log_depth();
+  float log_depth_step = (target_log_depth - vib_log_depth) / frames;
+  float w = 2 * PI * get_vib_rate() / SAMPLE_RATE;
+  float cos_w = cosf(w), sin_w = sinf(w);
+
+  for (unsigned int i = 0; i < frames; i++) {
+    // exp(x) to second order, which is plenty for depths of at most 1.04
+    float x = vib_log_depth * vib_sin;
+    vibs[i] = 1 + x + 0.5 * x * x;
+    float next_sin = vib_sin * cos_w + vib_cos * sin_w;
+    vib_cos = vib_cos * cos_w - vib_sin * sin_w;
+    vib_sin = next_sin;
+    vib_log_depth += log_depth_step;
+  }
+
+  // Rounding errors make the pair drift off the unit circle over time
+  float norm = sqrtf(square(vib_sin) + square(vib_cos));
+  vib_sin /= norm;
+  vib_cos /= norm;
+  vib_log_depth = target_log_depth;
+}
+
+// Fills freqs with the frequency of note at each frame of the block, vibrato
+// included. The frequency first follows the autogliss on the note, if any,
+// then ramps exponentially from there to target_freq by the end of the block.
+static void ramp_note_freq(int note, float target_freq, const float *vibs, float *freqs, unsigned int frames) {
+  float freq = voices.freqs[note];
+  unsigned int i = 0;
+
+  unsigned int glide_frames = min((unsigned int)voices.glide_frames_left[note], frames);
+  if (glide_frames > 0) {
+    float glide_ratio = voices.glide_ratios[note];
+    for (; i < glide_frames; i++) {
+      freqs[i] = freq * vibs[i];
+      freq *= glide_ratio;
+    }
+    voices.glide_frames_left[note] -= glide_frames;
+    if (voices.glide_frames_left[note] == 0)
+      freq = voices.glide_target_freqs[note];
+  }
+
+  if (i < frames) {
+    float freq_ratio = powf(target_freq / freq, 1.0 / (frames - i));
+    for (; i < frames; i++) {
+      freqs[i] = freq * vibs[i];
+      freq *= freq_ratio;
+    }
+    // Set exactly rather than keeping freq, so that rounding errors don't build up
+    freq = target_freq;
+  }
+
+  voices.freqs[note] = freq;
+}
+
+// Adds a block of note's output into out, for periodic instruments.
+static void render_oscillator(Instrument *instrument, int note, const float *freqs, float *out, unsigned int frames) {
+  float vol = voices.vols[note] * MAX_VOL;
+  float phase = voices.phases[note];
+  for (unsigned int i = 0; i < frames; i++) {
+    out[i] += vol * oscillate(instrument, phase);
+    phase += freqs[i] / SAMPLE_RATE;
+    if (phase >= 1)
+      phase -= 1.0;
+  }
+  voices.phases[note] = phase;
+}
+
+// Adds a block of note's output into out, for sample instruments. Here freqs
+// holds playback speeds rather than frequencies.
+static void render_sample(const Sample *sample, int note, const float *freqs, float *out, unsigned int frames) {
+  float vol = voices.vols[note] * sample->volume_modifier * SAMPLE_GAIN;
+  double position = voices.sample_positions[note];
+  double speed = (double)sample->sample_rate / SAMPLE_RATE;
+  NoteState s = voices.note_states[note];
+  bool should_loop = sample->play_continuously && (s == PRESSED || s == HELD);
+  // The last frame is only ever interpolated towards
+  int last_frame = sample->num_frames - 1;
+  // Frames are read through a window of float frames, which is converted a
+  // block at a time from compact samples
+  float window_buffer[CONVERT_BLOCK_FRAMES];
+  const float *window = NULL;
+  int window_start = 0, window_end = 0;
+
+  for (unsigned int i = 0; i < frames; i++) {
+    int frame = (int)position;
+    if (frame >= last_frame) {
+      if (!should_loop) {
+	voices.sample_playing[note] = false;
+	break;
+      }
+      // One step can cover the whole loop several times over, for samples of
+      // only a few frames played fast
+      position = fmod(position, last_frame);
+      frame = (int)position;
+    }
+    if (frame < window_start || frame+1 >= window_end) {
+      int num_frames = min(CONVERT_BLOCK_FRAMES, sample->num_frames - frame);
+      window = get_sample_frames(sample, frame, num_frames, window_buffer);
+      window_start = frame;
+      window_end = frame + num_frames;
+    }
+    float t = position - frame;
+    float a = window[frame - window_start], b = window[frame+1 - window_start];
+    out[i] += vol * (a + t * (b - a));
+    position += freqs[i] * speed;
+  }
+  voices.sample_positions[note] = position;
+}
+
+// Frame of a streamed sample, from its head or from the voice's stream. Frames
+// that haven't been streamed in yet are silent.
+static float get_streamed_frame(const Sample *sample, StreamWindow window, long frame, bool *is_underrun) {
+  if (frame < sample->num_loaded_frames)
+    return ((const float *)sample->data)[frame];
+  if (frame < window.end)
+    return window.buffer[frame & (STREAM_RING_SIZE-1)];
+  *is_underrun = true;
+  return 0;
+}
+
+// Like render_sample(), but for samples too long to be kept in memory. The
+// position here keeps counting up past the end of a looping sample, the same
+// way the reader thread counts frames (see fill_ring()).
+static void render_streamed_sample(const Sample *sample, int note, const float *freqs, float *out, unsigned int frames) {
+  float vol = voices.vols[note] * sample->volume_modifier * SAMPLE_GAIN;
+  double position = voices.sample_positions[note];
+  double speed = (double)sample->sample_rate / SAMPLE_RATE;
+  NoteState s = voices.note_states[note];
+  bool should_loop = sample->play_continuously && (s == PRESSED || s == HELD);
+  StreamWindow window = get_stream_window(note);
+  bool is_underrun = false;
+  int loop_length = sample->num_frames - 1;
+  double loop_end = (floor(position / loop_length) + 1) * loop_length;
+
+  for (unsigned int i = 0; i < frames; i++) {
+    if (position >= loop_end) {
+      if (!should_loop) {
+	voices.sample_playing[note] = false;
+	stop_stream(note);
+	break;
+      }
+      loop_end += loop_length;
+    }
+    long frame = (long)position;
+    float t = position - frame;
+    float a = get_streamed_frame(sample, window, frame, &is_underrun);
+    float b = get_streamed_frame(sample, window, frame+1, &is_underrun);
+    out[i] += vol * (a + t * (b - a));
+    position += freqs[i] * speed;
+  }
+  voices.sample_positions[note] = position;
+  set_stream_read_frame(note, (long)position);
+  if (is_underrun)
+    count_stream_underrun();
+}
+
+// Starts an autogliss from the exact pitch (and phase) from_note is at, even if
+// it is in the middle of an autogliss itself.
+static void start_autogliss(Autogliss autogliss, const float *target_freqs) {
+  int from = autogliss.from_note;
+  int to = autogliss.to_note;
+  if (from == NIL || to == NIL || autogliss.num_frames <= 0)
+    return;
+  if (voices.freqs[from] == 0 || target_freqs[to] == 0)
+    return;
+  voices.freqs[to] = voices.freqs[from];
+  voices.phases[to] = voices.phases[from];
+  voices.sample_positions[to] = voices.sample_positions[from];
+  voices.sample_playing[to] = voices.sample_playing[from];
+  voices.glide_target_freqs[to] = target_freqs[to];
+  voices.glide_frames_left[to] = autogliss.num_frames;
+  voices.glide_ratios[to] = powf(target_freqs[to] / voices.freqs[to], 1.0 / autogliss.num_frames);
+}
+
+static bool should_stop_sample(const Sample *sample, NoteState s) {
+  return s == IDLE || (sample->stop_on_release && (s == RELEASED || s == STILLRELEASED));
+}
+
+static void render_notes(float *out, unsigned int frames) {
+  float vibs[frames];
+  float freqs[frames];
+  float target_freqs[NOTETABLE_SIZE];
+  // Snapshot of the instrument, so that edits from the GUI thread can't take
+  // effect halfway through a block
   Instrument instrument = *get_cur_instrument();
-  float amplitude = 0;
-  float vol = 0;
-  float y;
+  // The table itself is read again with acquire, so that all of a table
+  // swapped in by the loader is seen (see swap_sample_table())
+  const Sample *samples = atomic_load_explicit(&get_cur_instrument()->samples, memory_order_acquire);
+  bool is_sampled = instrument.type == SAMPLE || instrument.type == MULTISAMPLE;
+  // Autogliss has to be fetched before the onsets, as its onset is published
+  // before it is.
+  Autogliss autogliss;
+  bool is_new_autogliss = get_new_autogliss(&autogliss_seq, &autogliss);
+
+  if (is_sampled)
+    get_sample_pitches(samples, target_freqs);
+  else
+    get_cur_base_freqs(target_freqs);
+  render_vibrato(vibs, frames);
+
+  // A newly pressed note starts right at its pitch instead of ramping to it
+  // from wherever it was last played.
+  bool is_restarted[NOTETABLE_SIZE] = {0};
   for (int note = 0; note < NOTETABLE_SIZE; note++) {
-    vol = get_actual_vols()[note] * MAX_VOL;
-    switch (instrument.type) {
-    case PULSE: y = pulse(phases[note], instrument.pulse_width); break;
-    case TRI: y = tri(phases[note], instrument.tri_nes_style); break;
-    case SAW: y = saw(phases[note], instrument.saw_nes_style); break;
-    case SINE: y = sine(phases[note], instrument.sine_coeffs); break;
-    case SAMPLE: case MULTISAMPLE: y = 0; break;
+    if (voices.onsets[note] != voices.seen_onsets[note] || voices.freqs[note] == 0) {
+      is_restarted[note] = true;
+      voices.seen_onsets[note] = voices.onsets[note];
+      voices.freqs[note] = target_freqs[note];
+      voices.glide_frames_left[note] = 0;
+      voices.sample_positions[note] = 0;
+      voices.sample_playing[note] = true;
+    }
+  }
+  if (is_new_autogliss) {
+    start_autogliss(autogliss, target_freqs);
+    // Carries on from the position it was given, which may not be streamed in
+    // for this voice yet
+    if (autogliss.to_note != NIL)
+      is_restarted[autogliss.to_note] = true;
+  }
+
+  for (int note = 0; note < NOTETABLE_SIZE; note++) {
+    const Sample *sample = &samples[note];
+    if (is_sampled && should_stop_sample(sample, voices.note_states[note]))
+      voices.sample_playing[note] = false;
+
+    // The stream is restarted whenever the sample itself changes too, e.g. when
+    // loading swaps the instrument's samples
+    bool is_streamed = is_sampled && sample->is_ready && sample->stream != NULL && voices.sample_playing[note];
+    if (!is_streamed)
+      stop_stream(note);
+    else if (is_restarted[note] || get_stream_source(note) != sample->stream)
+      start_stream(note, sample->stream, sample->play_continuously, (long)voices.sample_positions[note]);
+
+    // Notes that the tuning leaves unmapped have frequency 0, and are silent.
+    // An autogliss can start a frame before its note gets any volume, so it is
+    // left alone here.
+    bool is_silent = voices.vols[note] == 0 || target_freqs[note] == 0;
+    if (is_sampled)
+      is_silent = is_silent || !sample->is_ready || !voices.sample_playing[note];
+    if (is_silent) {
+      if (voices.glide_frames_left[note] == 0)
+	voices.freqs[note] = target_freqs[note];
+      continue;
     }
-    amplitude += vol * y;
+
+    ramp_note_freq(note, target_freqs[note], vibs, freqs, frames);
+    if (is_streamed)
+      render_streamed_sample(sample, note, freqs, out, frames);
+    else if (is_sampled)
+      render_sample(sample, note, freqs, out, frames);
+    else
+      render_oscillator(&instrument, note, freqs, out, frames);
   }
-  return amplitude;
 }
 
 void write_audio_samples(void *buffer, unsigned int frames) {
   short* d = (short*)buffer;
   float wavbuf[frames];
+  float out[frames];
   float amplitude;
 
+  memset(out, 0, frames * sizeof(float));
+  if (get_num_instruments() > 0)
+    render_notes(out, frames);
+  update_meters(out, frames);
+
   for (unsigned int i = 0; i < frames; i++) {
-    amplitude = get_amplitude(cur_phases);
-    amplitude = fclamp(amplitude, -0.5, 0.5);
+    amplitude = fclamp(out[i], -0.5, 0.5);
+    out[i] = amplitude;
     d[i] = (short)(amplitude * pow(2, BIT_DEPTH));
     if (is_recording) {
       // For some reason, these changes need to be made to the
@@ -76,15 +339,14 @@ void write_audio_samples(void *buffer, unsigned int frames) {
       amplitude -= fmodf2(amplitude, 0.01);
       wavbuf[i] = amplitude;
     }
-
-    for (int note = 0; note < NOTETABLE_SIZE; note++) {
-      if (get_actual_vols()[note] == 0) continue;
-      cur_phases[note] += get_cur_actual_freqs()[note] / SAMPLE_RATE;
-      if (cur_phases[note] >= 1)
-	cur_phases[note] -= 1.0;
-    }
   }
 
   if (is_recording)
     tinywav_write_f(&tw, wavbuf, frames);
+  write_scope_frames(out, frames);
+  atomic_fetch_add(&num_audio_blocks, 1);
+}
+
+unsigned get_num_audio_blocks() {
+  return atomic_load(&num_audio_blocks);
 }
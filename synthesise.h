@@ -1,18 +1,25 @@
 #ifndef SYNTHESISE
 #define SYNTHESISE
 
+#include <stdatomic.h>
 #include "tinywav/tinywav.h"
 #include "globals.h"
 #include "util.h"
 #include "freq.h"
 #include "volume.h"
 #include "instrument.h"
+#include "sample.h"
+#include "scope.h"
+#include "meter.h"
 
 // How loud should this program be compared to the actual
 // system volume, from 0 to 1?
 #define MAX_VOL 0.3
 
-float get_amplitude(float *phases);
 void write_audio_samples(void *buffer, unsigned int frames);
+/* Number of audio blocks that have been completely rendered. Anything that a
+   block could have read before the count was taken is safe to free once the
+   count has gone up by two. */
+unsigned get_num_audio_blocks();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,63 @@
+// Packs a sample instrument with vibro-pack, as in the example in pack.c, and
+// checks that loading the bank gives the instrument the settings in the
+// manifest, the envelope in particular.
+
+#include "bank.h"
+#include "sample.h"
+
+#define DIR "tests/bank_test_files/"
+
+static bool ok = true;
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    printf("bank_test: %s\n", what);
+    ok = false;
+  }
+}
+
+int main() {
+  SetTraceLogLevel(LOG_WARNING);
+  init_tuning();
+  if (!make_directory(DIR)) {
+    printf("bank_test: could not make %s\n", DIR);
+    return 1;
+  }
+  int16_t pcm[1000];
+  for (int i = 0; i < 1000; i++)
+    pcm[i] = i;
+  FILE *manifest = fopen(DIR "bank.txt", "w");
+  bool is_written = write_wav_file(DIR "bass_c.wav", SAMPLE_RATE, PCM_S16, pcm, 1000) && manifest != NULL;
+  if (manifest != NULL) {
+    fprintf(manifest, "instrument sample Bass\n");
+    fprintf(manifest, "sample 0 bass_c.wav pitch=0.5 loop attack=20 decay=10 sustain=0.6\n");
+    fclose(manifest);
+  }
+  check(is_written, "could not write the manifest");
+  check(is_written && system("./vibro-pack " DIR "bank.txt " DIR "bank.vbk > " DIR "pack.log") == 0, "vibro-pack failed");
+
+  if (ok && load_sample_bank(DIR "bank.vbk")) {
+    Instrument *instrument = &get_instruments()[get_num_instruments() - 1];
+    const Sample *sample = &instrument->samples[0];
+    check(instrument->type == SAMPLE, "the instrument should be a sample instrument");
+    check(sample->is_ready && sample->num_frames == 1000 && ((const int16_t *)sample->data)[999] == 999,
+	  "the sample data should be loaded as packed");
+    check(sample->pitch_modifier == 0.5f && sample->play_continuously, "the sample settings should be loaded");
+    check(instrument->adsr.attack_frames == 20 && instrument->adsr.decay_frames == 10
+	  && instrument->adsr.sustain_vol == 0.6f && instrument->adsr.release_frames == 20,
+	  "the instrument envelope should be the one in the manifest");
+    cleanup_instruments();
+    cleanup_sample_banks();
+  }
+  else
+    check(false, "could not load the bank");
+
+  remove(DIR "bass_c.wav");
+  remove(DIR "bank.txt");
+  remove(DIR "bank.vbk");
+  remove(DIR "pack.log");
+  remove(DIR);
+  if (ok)
+    printf("bank_test: passed\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+// A looping sample of only two frames, played fast enough that one step of
+// the playback position covers the whole loop several times over, must wrap
+// back inside the sample rather than read past its end.
+
+#include "synthesise.h"
+
+#define NUM_FRAMES 512
+// Past the end of the sample, where nothing should ever be read
+#define GUARD 1000.0f
+
+int main() {
+  SetTraceLogLevel(LOG_WARNING);
+  init_tuning();
+  add_instrument();
+  Instrument *instrument = get_cur_instrument();
+  instrument->type = SAMPLE;
+
+  int note = NOTETABLE_SIZE - 1;
+  static const float data[] = {0.5f, -0.5f, GUARD, GUARD, GUARD, GUARD};
+  Sample *sample = &instrument->samples[note];
+  sample->is_ready = true;
+  sample->sample_rate = SAMPLE_RATE;
+  sample->num_frames = 2;
+  sample->num_loaded_frames = 2;
+  sample->format = PCM_F32;
+  sample->data = data;
+  sample->play_continuously = true;
+  sample->pitch_modifier = 4;
+
+  voices.note_states[note] = HELD;
+  voices.onsets[note] = 1;
+  voices.vols[note] = 1;
+
+  // The position is left one step past the last frame read, which with the
+  // wrapping should never be more than a step past the end of the sample
+  float pitches[NOTETABLE_SIZE];
+  get_sample_pitches(instrument->samples, pitches);
+  double max_position = sample->num_frames + 2 * pitches[note];
+
+  short buffer[NUM_FRAMES];
+  bool ok = true;
+  for (int block = 0; block < 4 && ok; block++) {
+    take_meter_peak();
+    write_audio_samples(buffer, NUM_FRAMES);
+    double position = voices.sample_positions[note];
+    float peak = take_meter_peak();
+    if (!voices.sample_playing[note] || position < 0 || position >= max_position) {
+      printf("sample_loop_test: block %d: position %f is outside the sample\n", block, position);
+      ok = false;
+    }
+    // Anything read from the guard would be far louder than the sample
+    if (peak > 0) {
+      printf("sample_loop_test: block %d: peak of %.1f dBFS, read past the sample\n", block, peak);
+      ok = false;
+    }
+  }
+  if (ok)
+    printf("sample_loop_test: passed\n");
+  return ok ? 0 : 1;
+}
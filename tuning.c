@@ -0,0 +1,215 @@
+#include "tuning.h"
+
+// The MIDI key that a note at octave 0 with note = 0 (i.e. C4) corresponds to
+#define C4_KEY 60
+
+// A scale as given by a .scl file: the frequency ratios of degrees 1 to
+// size, relative to degree 0. The last ratio is the period of the scale
+// (usually 2, for an octave).
+typedef struct {
+  int size;
+  double ratios[MAX_SCALE_SIZE];
+} Scale;
+
+// A keyboard mapping as given by a .kbm file. See
+// https://www.huygens-fokker.org/scala/help.htm#mappings for the details.
+typedef struct {
+  int size;  // 0 means that consecutive keys are mapped to consecutive degrees
+  int first_key;
+  int last_key;
+  int middle_key;  // Key that is mapped to degree 0
+  int reference_key;
+  double reference_freq;
+  int octave_degree;  // Number of degrees the mapping moves up on every repeat
+  int degrees[MAX_KEYBOARD_MAP_SIZE];  // NIL for unmapped keys
+} KeyboardMap;
+
+static Scale scale;
+static KeyboardMap keyboard_map;
+
+#define NUM_OCTAVES (MAX_OCTAVE - MIN_OCTAVE + 1)
+// get_note_freq() is called with note-1, so the table starts from note = -1.
+static float freq_table[NUM_OCTAVES][NOTETABLE_SIZE];
+
+static int floor_div(int a, int b) {
+  return (a - mod(a, b)) / b;
+}
+
+// Reads the next line of f that isn't a comment into line. Returns false at EOF.
+static bool read_scala_line(FILE *f, char *line, int size) {
+  while (fgets(line, size, f) != NULL) {
+    if (line[0] != '!')
+      return true;
+  }
+  return false;
+}
+
+// Parses a pitch line of a .scl file into a frequency ratio, or returns 0 if
+// it is malformed. Pitches containing a period are in cents; everything else
+// is a ratio like 3/2, or a whole number.
+static double parse_scala_pitch(const char *line) {
+  char *end;
+  while (*line == ' ' || *line == '\t')
+    line++;
+  const char *period = strchr(line, '.');
+  const char *space = line + strcspn(line, " \t\r\n");
+  if (period != NULL && period < space) {
+    double cents = strtod(line, &end);
+    return end == line ? 0 : pow(2, cents / 1200);
+  }
+  long numerator = strtol(line, &end, 10);
+  if (end == line || numerator <= 0)
+    return 0;
+  if (*end != '/')
+    return numerator;
+  const char *denominator_start = end + 1;
+  long denominator = strtol(denominator_start, &end, 10);
+  if (end == denominator_start || denominator <= 0)
+    return 0;
+  return (double)numerator / denominator;
+}
+
+static double get_degree_ratio(int degree) {
+  int num_periods = floor_div(degree, scale.size);
+  int step = mod(degree, scale.size);
+  double ratio = pow(scale.ratios[scale.size - 1], num_periods);
+  if (step > 0)
+    ratio *= scale.ratios[step - 1];
+  return ratio;
+}
+
+// Returns the scale degree that key is mapped to, or NIL if it is unmapped.
+static int get_key_degree(int key) {
+  if (keyboard_map.size == 0)
+    return key - keyboard_map.middle_key;
+  int offset = key - keyboard_map.middle_key;
+  int degree = keyboard_map.degrees[mod(offset, keyboard_map.size)];
+  if (degree == NIL)
+    return NIL;
+  // A formal octave of 0 means the period of the scale
+  int octave_degree = keyboard_map.octave_degree == 0 ? scale.size : keyboard_map.octave_degree;
+  return floor_div(offset, keyboard_map.size) * octave_degree + degree;
+}
+
+static void build_freq_table() {
+  int reference_degree = get_key_degree(keyboard_map.reference_key);
+  if (reference_degree == NIL)
+    reference_degree = keyboard_map.reference_key - keyboard_map.middle_key;
+  double base_freq = keyboard_map.reference_freq / get_degree_ratio(reference_degree);
+
+  for (int octave = MIN_OCTAVE; octave <= MAX_OCTAVE; octave++) {
+    for (int note = -1; note < NOTETABLE_SIZE - 1; note++) {
+      int key = C4_KEY + 12 * octave + note;
+      int degree = get_key_degree(key);
+      float freq = 0;
+      if (key >= keyboard_map.first_key && key <= keyboard_map.last_key && degree != NIL)
+	freq = base_freq * get_degree_ratio(degree);
+      freq_table[octave - MIN_OCTAVE][note + 1] = freq;
+    }
+  }
+}
+
+static void init_keyboard_map(KeyboardMap *map) {
+  map->size = 0;
+  map->first_key = 0;
+  map->last_key = 127;
+  map->middle_key = C4_KEY;
+  map->reference_key = C4_KEY;
+  map->reference_freq = C4;
+  map->octave_degree = 0;
+}
+
+void init_tuning() {
+  scale.size = 12;
+  for (int i = 0; i < 12; i++)
+    scale.ratios[i] = pow(2, (i + 1) / 12.0);
+  init_keyboard_map(&keyboard_map);
+  build_freq_table();
+}
+
+bool load_scala_scale(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    TraceLog(LOG_WARNING, "TUNING: Could not open scale %s", path);
+    return false;
+  }
+
+  Scale new_scale = {0};
+  char line[256];
+  bool ok = read_scala_line(f, line, sizeof(line));  // Description
+  ok = ok && read_scala_line(f, line, sizeof(line));
+  if (ok) {
+    new_scale.size = atoi(line);
+    ok = new_scale.size > 0 && new_scale.size <= MAX_SCALE_SIZE;
+  }
+  for (int i = 0; ok && i < new_scale.size; i++) {
+    ok = read_scala_line(f, line, sizeof(line));
+    if (ok)
+      new_scale.ratios[i] = parse_scala_pitch(line);
+    ok = ok && new_scale.ratios[i] > 0;
+  }
+  fclose(f);
+
+  if (!ok) {
+    TraceLog(LOG_WARNING, "TUNING: Malformed scale %s", path);
+    return false;
+  }
+  scale = new_scale;
+  build_freq_table();
+  TraceLog(LOG_INFO, "TUNING: Loaded %d-note scale %s", scale.size, path);
+  return true;
+}
+
+bool load_scala_keyboard_map(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    TraceLog(LOG_WARNING, "TUNING: Could not open keyboard mapping %s", path);
+    return false;
+  }
+
+  KeyboardMap new_map;
+  init_keyboard_map(&new_map);
+  int *header_fields[] = {
+    &new_map.size, &new_map.first_key, &new_map.last_key,
+    &new_map.middle_key, &new_map.reference_key
+  };
+  char line[256];
+  bool ok = true;
+  for (int i = 0; ok && i < 5; i++) {
+    ok = read_scala_line(f, line, sizeof(line));
+    if (ok)
+      *header_fields[i] = atoi(line);
+  }
+  ok = ok && new_map.size >= 0 && new_map.size <= MAX_KEYBOARD_MAP_SIZE;
+  ok = ok && read_scala_line(f, line, sizeof(line));
+  if (ok) {
+    new_map.reference_freq = strtod(line, NULL);
+    ok = new_map.reference_freq > 0;
+  }
+  ok = ok && read_scala_line(f, line, sizeof(line));
+  if (ok)
+    new_map.octave_degree = atoi(line);
+  // Entries left out at the end of the file are unmapped
+  for (int i = 0; ok && i < new_map.size; i++) {
+    if (!read_scala_line(f, line, sizeof(line)) || line[strspn(line, " \t")] == 'x')
+      new_map.degrees[i] = NIL;
+    else
+      new_map.degrees[i] = atoi(line);
+  }
+  fclose(f);
+
+  if (!ok) {
+    TraceLog(LOG_WARNING, "TUNING: Malformed keyboard mapping %s", path);
+    return false;
+  }
+  keyboard_map = new_map;
+  build_freq_table();
+  TraceLog(LOG_INFO, "TUNING: Loaded keyboard mapping %s", path);
+  return true;
+}
+
+float get_tuned_freq(int note, int octave) {
+  octave = clamp(octave, MIN_OCTAVE, MAX_OCTAVE);
+  note = clamp(note, -1, NOTETABLE_SIZE - 2);
+  return freq_table[octave - MIN_OCTAVE][note + 1];
+}
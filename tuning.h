@@ -0,0 +1,32 @@
+#ifndef _TUNING
+#define _TUNING
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "raylib.h"
+#include "util.h"
+#include "note.h"
+#include "octave.h"
+
+#define C4 261.625565 // In Hz, so that A4 = 440Hz in equal temperament
+
+// Limits on Scala files that we bother to read
+#define MAX_SCALE_SIZE 128
+#define MAX_KEYBOARD_MAP_SIZE 128
+
+// Every (note, octave) pair that get_note_freq() can be asked about has its
+// frequency precomputed in a table, which is rebuilt whenever the tuning
+// changes. By default the tuning is 12-tone equal temperament, and when only a
+// scale is loaded, its degree 0 is mapped to C4.
+
+void init_tuning();
+/* Load a Scala scale (.scl) and rebuild the frequency table.
+   Returns false and leaves the tuning unchanged if the file can't be read. */
+bool load_scala_scale(const char *path);
+/* Load a Scala keyboard mapping (.kbm) and rebuild the frequency table.
+   Returns false and leaves the tuning unchanged if the file can't be read. */
+bool load_scala_keyboard_map(const char *path);
+/* Same arguments as get_note_freq(). Unmapped keys have frequency 0. */
+float get_tuned_freq(int note, int octave);
+
+#endif
@@ -1,20 +1,41 @@
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "tinywav/tinywav.h"
 #include "raylib.h"
 #include "util.h"
 #include "globals.h"
 #include "freq.h"
+#include "tuning.h"
 #include "synthesise.h"
 #include "play_mode.h"
 #include "instrument_mode.h"
+#include "loader.h"
+#include "bank.h"
 
 typedef enum {
   PLAY_MODE, INSTRUMENT_MODE
 } GuiMode;
 
-int main() {
+int main(int argc, char **argv) {
+  // Usage: vibro [--bank BANK.vbk]... [SCALE.scl [KEYBOARD_MAPPING.kbm]]
+  const char *bank_paths[argc];
+  const char *tuning_paths[2];
+  int num_banks = 0, num_tuning_paths = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--bank") == 0 && i+1 < argc)
+      bank_paths[num_banks++] = argv[++i];
+    else if (num_tuning_paths < 2)
+      tuning_paths[num_tuning_paths++] = argv[i];
+  }
+
+  init_tuning();
+  if (num_tuning_paths > 0)
+    load_scala_scale(tuning_paths[0]);
+  if (num_tuning_paths > 1)
+    load_scala_keyboard_map(tuning_paths[1]);
+
   InitWindow(INITIAL_WIDTH, INITIAL_HEIGHT, "vibro");
   InitAudioDevice();
   SetAudioStreamBufferSizeDefault(MAX_SAMPLES_PER_UPDATE);
@@ -27,8 +48,24 @@ int main() {
   SetTargetFPS(FPS);
 
   GuiMode gui_mode = PLAY_MODE;
-  add_instrument();
-
+  init_streaming();
+  init_sample_disk_cache();
+  init_sample_library();
+  init_sample_loader();
+  init_analysis();
+  const char *budget_mb = getenv("VIBRO_SAMPLE_MEMORY_MB");
+  if (budget_mb != NULL && atoi(budget_mb) > 0)
+    set_sample_memory_budget((size_t)atoi(budget_mb) * 1024 * 1024);
+  const char *compact = getenv("VIBRO_COMPACT_SAMPLES");
+  if (compact != NULL)
+    set_compact_sample_storage(atoi(compact) != 0);
+  for (int i = 0; i < num_banks; i++)
+    load_sample_bank(bank_paths[i]);
+  if (get_num_instruments() == 0)
+    add_instrument();
+
+  int frames_since_draw = 0;
+  double frame_end = GetTime();
   while (!WindowShouldClose()) {
     screen_width = GetScreenWidth();
     screen_height = GetScreenHeight();
@@ -77,6 +114,8 @@ int main() {
       }
     }
 
+    update_sample_loads();
+
     if (gui_mode == PLAY_MODE) {
       if (IsKeyPressed(KEY_LEFT))
 	select_previous_instrument();
@@ -85,20 +124,52 @@ int main() {
     }
 
     switch (gui_mode) {
-    case PLAY_MODE: play_mode_gui(); break;
-    case INSTRUMENT_MODE: instrument_mode_gui(); break;
+    case PLAY_MODE: update_play_mode(); break;
+    case INSTRUMENT_MODE: update_instrument_mode(); break;
     }
-  }
 
-  cleanup_instruments();
-  if (gui_mode == INSTRUMENT_MODE)
-    cleanup_instrument_mode_state();
+    // When idle, only every (FPS/IDLE_FPS)th frame is drawn. The others just
+    // wait out the frame and poll input, as EndDrawing() would have.
+    frames_since_draw++;
+    bool is_idle = is_silent() && !has_input_activity();
+    if (!is_idle || frames_since_draw >= FPS / IDLE_FPS) {
+      // EndDrawing() times the frame from the end of the last one it drew,
+      // so it is told how many frames ago that was. This divides FPS exactly,
+      // as FPS is a multiple of IDLE_FPS.
+      SetTargetFPS(FPS / frames_since_draw);
+      switch (gui_mode) {
+      case PLAY_MODE: draw_play_mode(); break;
+      case INSTRUMENT_MODE: draw_instrument_mode(); break;
+      }
+      frames_since_draw = 0;
+    }
+    else {
+      double wait = frame_end + 1.0 / FPS - GetTime();
+      if (wait > 0)
+	WaitTime(wait);
+      PollInputEvents();
+    }
+    frame_end = GetTime();
+  }
 
   if (is_recording)
     tinywav_close_write(&tw);
+  cleanup_instrument_mode_gui();
+  cleanup_text_cache();
+  cleanup_roll();
   CloseWindow();
   UnloadAudioStream(stream);
   CloseAudioDevice();
 
+  // Samples are only freed once nothing can be playing or streaming them
+  cleanup_analysis();
+  cleanup_sample_loader();
+  cleanup_streaming();
+  cleanup_instruments();
+  if (gui_mode == INSTRUMENT_MODE)
+    cleanup_instrument_mode_state();
+  cleanup_sample_banks();
+  cleanup_sample_library();
+
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,3 @@
+#include "voice.h"
+
+alignas(CACHE_LINE_SIZE) VoiceTable voices;
@@ -0,0 +1,73 @@
+#ifndef _VOICE
+#define _VOICE
+
+#include <stdalign.h>
+#include "globals.h"
+
+// The total number of notes that can be played via key presses
+// NOTE: the QWERTY row and number row keys are only bound to notes in chord
+// mode. In solo mode, they are not bound to anything, so the number of playable
+// notes is actually 18.
+#define NOTETABLE_SIZE 33
+// Every per-voice array is padded up to a multiple of 8 entries, so that loops
+// over all voices can be done in whole vector registers. The padding voices
+// are always silent.
+#define VOICE_TABLE_SIZE 40
+#define CACHE_LINE_SIZE 64
+
+// A note is PRESSED on the very first frame the corresponding key is pressed,
+// and RELEASED on the very first frame the corresponding key is released.
+// STILLRELEASED means the ADSR envelope for that note is at the RELEASE stage
+// (meaning it is still audible in the output), and IDLE means the note is
+// completely silent.
+typedef enum {
+  PRESSED, HELD, RELEASED, STILLRELEASED, IDLE
+} NoteState;
+
+typedef enum {
+  ATTACK, DECAY, SUSTAIN, RELEASE
+} ADSRState;
+
+#define VOICE_ARRAY(type, name) alignas(CACHE_LINE_SIZE) type name[VOICE_TABLE_SIZE]
+
+// All per-note state, with one voice per note in the notetable. Each field is
+// its own cache-aligned array, so that a loop touching one field of every
+// voice reads a few contiguous cache lines.
+typedef struct {
+  /** Updated once per frame by the GUI thread **/
+  VOICE_ARRAY(NoteState, note_states);
+  // Incremented every frame a note is PRESSED. The audio thread may not run
+  // between two frames, so it compares these counts instead of looking for the
+  // PRESSED state itself.
+  VOICE_ARRAY(unsigned, onsets);
+  // The octave of a note in the RELEASE state of the ADSR envelope shouldn't
+  // change, so we store the octave it was released at.
+  VOICE_ARRAY(int, octaves_on_release);
+  // Volumes that are updated frame-by-frame according to the ADSR envelope
+  VOICE_ARRAY(float, vols);
+  VOICE_ARRAY(ADSRState, adsr_states);
+  // Value of vols right when release starts
+  VOICE_ARRAY(float, release_peaks);
+
+  /** Owned by the audio thread **/
+  VOICE_ARRAY(float, phases);
+  // Frequency as of the end of the previous audio block
+  VOICE_ARRAY(float, freqs);
+  // onsets as of the previous audio block
+  VOICE_ARRAY(unsigned, seen_onsets);
+  // Autogliss in progress. Each audio frame the frequency is multiplied by
+  // glide_ratios, until glide_frames_left runs out at glide_target_freqs.
+  VOICE_ARRAY(int, glide_frames_left);
+  VOICE_ARRAY(float, glide_ratios);
+  VOICE_ARRAY(float, glide_target_freqs);
+  // Sample playback. For sample instruments, freqs hold the playback speed
+  // relative to the sample's own pitch instead of a frequency in Hz.
+  VOICE_ARRAY(bool, sample_playing);
+  VOICE_ARRAY(double, sample_positions);  // In frames of the sample
+} VoiceTable;
+
+#undef VOICE_ARRAY
+
+extern VoiceTable voices;
+
+#endif
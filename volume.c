@@ -1,9 +1,6 @@
 #include "volume.h"
 
 static float note_vol = 0.5;
-// Updates frame-by-frame according to ADSR envelope
-static float actual_vols[NOTETABLE_SIZE] = {0};
-static ADSRState adsr_states[NOTETABLE_SIZE] = {0};
 
 void update_note_vol() {
   note_vol += fclamp(mouse_dx * 0.001, -0.01, 0.01);
@@ -27,69 +24,68 @@ void update_note_vol() {
 }
 
 void apply_adsr() {
-  Instrument instrument = *get_cur_instrument();
-  static float release_peaks[NOTETABLE_SIZE] = {0};  // Value of actualvol right when release starts
+  Instrument *instrument = get_cur_instrument();
 
   for (int note = 0; note < NOTETABLE_SIZE; note++) {
     ADSRParams adsr;
-    if (instrument.type == MULTISAMPLE) {
-      if (instrument.samples[note].is_ready) {
-	adsr = instrument.samples[note].adsr;
+    if (instrument->type == MULTISAMPLE) {
+      if (instrument->samples[note].is_ready) {
+	adsr = instrument->samples[note].adsr;
       }
       else {
-	adsr_states[note] = RELEASE;
-	actual_vols[note] = 0;
+	voices.adsr_states[note] = RELEASE;
+	voices.vols[note] = 0;
 	continue;
       }
     }
     else
-      adsr = instrument.adsr;
+      adsr = instrument->adsr;
 
-    NoteState note_state = get_cur_note_states()[note];
+    NoteState note_state = voices.note_states[note];
 
     if (note_state == PRESSED) {
-      adsr_states[note] = ATTACK;
+      voices.adsr_states[note] = ATTACK;
       // It is possible to set this to 0 instead, but it results in unpleasant
       // popping noises when switching notes repeatedly
-      actual_vols[note] = note_vol / (float)adsr.attack_frames;
+      voices.vols[note] = note_vol / (float)adsr.attack_frames;
     }
     else if (note_state == HELD) {
-      if (adsr_states[note] == ATTACK) {
-	actual_vols[note] += note_vol / (float)adsr.attack_frames;
-	if (actual_vols[note] >= note_vol) {
-	  adsr_states[note] = DECAY;
-	  actual_vols[note] = note_vol;
+      if (voices.adsr_states[note] == ATTACK) {
+	voices.vols[note] += note_vol / (float)adsr.attack_frames;
+	if (voices.vols[note] >= note_vol) {
+	  voices.adsr_states[note] = DECAY;
+	  voices.vols[note] = note_vol;
 	}
       }
-      else if (adsr_states[note] == DECAY) {
-	actual_vols[note] -= (note_vol - adsr.sustain_vol * note_vol) / (float)adsr.decay_frames;
-	if (actual_vols[note] <= adsr.sustain_vol * note_vol) {
-	  adsr_states[note] = SUSTAIN;
-	  actual_vols[note] = adsr.sustain_vol * note_vol;
+      else if (voices.adsr_states[note] == DECAY) {
+	voices.vols[note] -= (note_vol - adsr.sustain_vol * note_vol) / (float)adsr.decay_frames;
+	if (voices.vols[note] <= adsr.sustain_vol * note_vol) {
+	  voices.adsr_states[note] = SUSTAIN;
+	  voices.vols[note] = adsr.sustain_vol * note_vol;
 	}
       }
-      else if (adsr_states[note] == SUSTAIN)  // Note that sustain_vol can change while note is being sustained
-	actual_vols[note] = adsr.sustain_vol * note_vol;
-      else if (adsr_states[note] == RELEASE) {  // Occurs during autogliss when note state is overriden from PRESSED to HELD
-	adsr_states[note] = SUSTAIN;
-	actual_vols[note] = adsr.sustain_vol * note_vol;
+      else if (voices.adsr_states[note] == SUSTAIN)  // Note that sustain_vol can change while note is being sustained
+	voices.vols[note] = adsr.sustain_vol * note_vol;
+      else if (voices.adsr_states[note] == RELEASE) {  // Occurs during autogliss when note state is overriden from PRESSED to HELD
+	voices.adsr_states[note] = SUSTAIN;
+	voices.vols[note] = adsr.sustain_vol * note_vol;
       }
     }
     else if (note_state == RELEASED) {
-      adsr_states[note] = RELEASE;
-      release_peaks[note] = actual_vols[note];
+      voices.adsr_states[note] = RELEASE;
+      voices.release_peaks[note] = voices.vols[note];
     }
     else if (note_state == STILLRELEASED) {
-      if (actual_vols[note] > 0)
-	actual_vols[note] -= release_peaks[note] / (float)adsr.release_frames;
+      if (voices.vols[note] > 0)
+	voices.vols[note] -= voices.release_peaks[note] / (float)adsr.release_frames;
       else {
 	kill_note(note);
-	actual_vols[note] = 0;
-	release_peaks[note] = 0;
+	voices.vols[note] = 0;
+	voices.release_peaks[note] = 0;
       }
     }
     else if (note_state == IDLE) {
-      actual_vols[note] = 0;
+      voices.vols[note] = 0;
     }
   }
 }
@@ -98,22 +94,15 @@ float get_note_vol() {
   return note_vol;
 }
 
-float *get_actual_vols() {
-  return actual_vols;
-}
-
-ADSRState *get_adsr_states() {
-  return adsr_states;
-}
-
 void kill_vols() {
-  for (int note = 0; note < NOTETABLE_SIZE; note++)
-    actual_vols[note] = 0;
+  for (int note = 0; note < VOICE_TABLE_SIZE; note++)
+    voices.vols[note] = 0;
 }
 
 bool is_silent() {
-  for (int note = 0; note < NOTETABLE_SIZE; note++)
-    if (actual_vols[note] > 0)
-      return false;
-  return true;
+  // Written without an early exit so that it compiles to a vector reduction
+  int num_sounding = 0;
+  for (int note = 0; note < VOICE_TABLE_SIZE; note++)
+    num_sounding += voices.vols[note] > 0;
+  return num_sounding == 0;
 }
\ No newline at end of file
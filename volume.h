@@ -6,16 +6,11 @@
 #include "note.h"
 #include "util.h"
 #include "instrument.h"
-
-typedef enum {
-  ATTACK, DECAY, SUSTAIN, RELEASE
-} ADSRState;
+#include "voice.h"
 
 void update_note_vol();
 void apply_adsr();
 float get_note_vol();
-float *get_actual_vols();
-ADSRState *get_adsr_states();
 void kill_vols();
 bool is_silent();
 
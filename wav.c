@@ -0,0 +1,434 @@
+#include "wav.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+bool get_file_stamp(const char *path, FileStamp *stamp) {
+  memset(stamp, 0, sizeof(FileStamp));
+  struct stat st;
+  if (stat(path, &st) < 0)
+    return false;
+  stamp->size = st.st_size;
+  stamp->mtime = st.st_mtime;
+  return true;
+}
+
+bool get_canonical_path(const char *path, char *out, size_t size) {
+#ifdef _WIN32
+  return _fullpath(out, path, size) != NULL;
+#else
+  char *resolved = realpath(path, NULL);
+  if (resolved == NULL)
+    return false;
+  bool fits = strlen(resolved) < size;
+  if (fits)
+    strcpy(out, resolved);
+  free(resolved);
+  return fits;
+#endif
+}
+
+bool is_same_file_stamp(const FileStamp *a, const FileStamp *b) {
+  return a->size == b->size && a->mtime == b->mtime;
+}
+
+#ifdef _WIN32
+bool map_file(const char *path, MappedFile *file) {
+  memset(file, 0, sizeof(MappedFile));
+  HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (f == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+    CloseHandle(f);
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+  // The mapping keeps the file open by itself
+  CloseHandle(f);
+  if (mapping == NULL)
+    return false;
+  file->bytes = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (file->bytes == NULL) {
+    CloseHandle(mapping);
+    return false;
+  }
+  file->size = size.QuadPart;
+  file->handle = mapping;
+  return true;
+}
+
+void unmap_file(MappedFile *file) {
+  if (file->bytes != NULL) {
+    UnmapViewOfFile(file->bytes);
+    CloseHandle(file->handle);
+  }
+  memset(file, 0, sizeof(MappedFile));
+}
+#else
+bool map_file(const char *path, MappedFile *file) {
+  memset(file, 0, sizeof(MappedFile));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void *bytes = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file open by itself
+  close(fd);
+  if (bytes == MAP_FAILED)
+    return false;
+  file->bytes = bytes;
+  file->size = st.st_size;
+  return true;
+}
+
+void unmap_file(MappedFile *file) {
+  if (file->bytes != NULL)
+    munmap((void *)file->bytes, file->size);
+  memset(file, 0, sizeof(MappedFile));
+}
+#endif
+
+size_t read_file_at(FILE *f, long long offset, void *out, size_t size) {
+#ifdef _WIN32
+  if (_fseeki64(f, offset, SEEK_SET) != 0)
+    return 0;
+#else
+  if (fseeko(f, offset, SEEK_SET) != 0)
+    return 0;
+#endif
+  return fread(out, 1, size, f);
+}
+
+bool make_directory(const char *path) {
+  struct stat st;
+  if (stat(path, &st) == 0)
+    return S_ISDIR(st.st_mode);
+#ifdef _WIN32
+  return _mkdir(path) == 0;
+#else
+  return mkdir(path, 0755) == 0;
+#endif
+}
+
+bool replace_file(const char *from, const char *to) {
+#ifdef _WIN32
+  // rename() doesn't replace existing files on Windows
+  return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING);
+#else
+  return rename(from, to) == 0;
+#endif
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t size) {
+  const unsigned char *p = bytes;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= p[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static size_t min_size(size_t a, size_t b) {
+  return a < b ? a : b;
+}
+
+static uint16_t read_u16(const unsigned char *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t read_u32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Reads the format out of the body of a "fmt " chunk, of which size bytes are
+// there to read
+static bool parse_fmt_chunk(const unsigned char *body, size_t size, WavInfo *info,
+			    int *audio_format, int *bits_per_sample) {
+  if (size < 16)
+    return false;
+  *audio_format = read_u16(body);
+  info->channels = read_u16(body + 2);
+  info->sample_rate = read_u32(body + 4);
+  info->bytes_per_frame = read_u16(body + 12);
+  *bits_per_sample = read_u16(body + 14);
+  // The actual format of WAVE_FORMAT_EXTENSIBLE is at the start of the
+  // subformat GUID
+  if (*audio_format == WAVE_FORMAT_EXTENSIBLE && size >= 26)
+    *audio_format = read_u16(body + 24);
+  return true;
+}
+
+static bool set_wav_format(WavInfo *info, int audio_format, int bits_per_sample) {
+  if (info->channels <= 0 || info->sample_rate <= 0)
+    return false;
+  if (audio_format == WAVE_FORMAT_PCM) {
+    switch (bits_per_sample) {
+    case 8: info->format = PCM_U8; break;
+    case 16: info->format = PCM_S16; break;
+    case 24: info->format = PCM_S24; break;
+    case 32: info->format = PCM_S32; break;
+    default: return false;
+    }
+  }
+  else if (audio_format == WAVE_FORMAT_IEEE_FLOAT) {
+    switch (bits_per_sample) {
+    case 32: info->format = PCM_F32; break;
+    case 64: info->format = PCM_F64; break;
+    default: return false;
+    }
+  }
+  else
+    return false;
+  return info->bytes_per_frame == info->channels * bits_per_sample / 8;
+}
+
+bool parse_wav_header(const MappedFile *file, WavInfo *info) {
+  const unsigned char *bytes = file->bytes;
+  size_t size = file->size;
+  if (size < 12 || memcmp(bytes, "RIFF", 4) != 0 || memcmp(bytes + 8, "WAVE", 4) != 0)
+    return false;
+
+  bool has_fmt = false;
+  int audio_format = 0;
+  int bits_per_sample = 0;
+  memset(info, 0, sizeof(WavInfo));
+
+  size_t pos = 12;
+  while (pos + 8 <= size) {
+    const unsigned char *chunk = bytes + pos;
+    size_t chunk_size = read_u32(chunk + 4);
+    size_t available = size - pos - 8;
+
+    if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16)
+      has_fmt = parse_fmt_chunk(chunk + 8, min_size(chunk_size, available), info,
+				&audio_format, &bits_per_sample);
+    else if (memcmp(chunk, "data", 4) == 0 && has_fmt) {
+      // Truncated files are read up to where they end
+      if (chunk_size > available)
+	chunk_size = available;
+      info->pcm = chunk + 8;
+      if (info->bytes_per_frame > 0)
+	info->num_frames = chunk_size / info->bytes_per_frame;
+      break;
+    }
+    // Chunks are padded to an even size
+    pos += 8 + chunk_size + (chunk_size % 2);
+  }
+
+  if (!has_fmt || info->pcm == NULL)
+    return false;
+  return set_wav_format(info, audio_format, bits_per_sample);
+}
+
+bool read_wav_header(FILE *f, WavInfo *info, long long *pcm_offset) {
+  struct stat st;
+  unsigned char header[12];
+  if (fstat(fileno(f), &st) < 0 || read_file_at(f, 0, header, 12) < 12
+      || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+    return false;
+
+  long long size = st.st_size;
+  bool has_fmt = false;
+  bool has_data = false;
+  int audio_format = 0;
+  int bits_per_sample = 0;
+  memset(info, 0, sizeof(WavInfo));
+
+  long long pos = 12;
+  unsigned char chunk[8 + 40];
+  while (!has_data && pos + 8 <= size) {
+    size_t num_read = read_file_at(f, pos, chunk, sizeof(chunk));
+    if (num_read < 8)
+      break;
+    long long chunk_size = read_u32(chunk + 4);
+    long long available = size - pos - 8;
+
+    if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16)
+      has_fmt = parse_fmt_chunk(chunk + 8, min_size(chunk_size, num_read - 8), info,
+				&audio_format, &bits_per_sample);
+    else if (memcmp(chunk, "data", 4) == 0 && has_fmt) {
+      if (chunk_size > available)
+	chunk_size = available;
+      *pcm_offset = pos + 8;
+      if (info->bytes_per_frame > 0)
+	info->num_frames = chunk_size / info->bytes_per_frame;
+      has_data = true;
+    }
+    pos += 8 + chunk_size + (chunk_size % 2);
+  }
+
+  if (!has_fmt || !has_data)
+    return false;
+  return set_wav_format(info, audio_format, bits_per_sample);
+}
+
+static float decode_pcm_sample(PcmFormat format, const unsigned char *p) {
+  switch (format) {
+  case PCM_U8:
+    return (p[0] - 128) / 128.0f;
+  case PCM_S16:
+    return (int16_t)read_u16(p) / 32768.0f;
+  case PCM_S24:
+    // Shift into the top of an int32 to sign-extend
+    return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) / 2147483648.0f;
+  case PCM_S32:
+    return (int32_t)read_u32(p) / 2147483648.0f;
+  case PCM_F32: {
+    float x;
+    memcpy(&x, p, sizeof(float));
+    return x;
+  }
+  case PCM_F64: {
+    double x;
+    memcpy(&x, p, sizeof(double));
+    return x;
+  }
+  }
+  return 0;
+}
+
+void decode_wav_frames(const WavInfo *info, int first_frame, int num_frames, float *out) {
+  int bytes_per_sample = info->bytes_per_frame / info->channels;
+  const unsigned char *p = info->pcm + (size_t)first_frame * info->bytes_per_frame;
+  for (int i = 0; i < num_frames; i++) {
+    float sum = 0;
+    for (int channel = 0; channel < info->channels; channel++) {
+      sum += decode_pcm_sample(info->format, p);
+      p += bytes_per_sample;
+    }
+    out[i] = sum / info->channels;
+  }
+}
+
+// Sign-extends a little-endian 24-bit sample
+static int32_t read_s24(const unsigned char *p) {
+  return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+}
+
+void decode_wav_frames_native(const WavInfo *info, int first_frame, int num_frames, unsigned char *out) {
+  int bytes_per_sample = info->bytes_per_frame / info->channels;
+  const unsigned char *p = info->pcm + (size_t)first_frame * info->bytes_per_frame;
+  for (int i = 0; i < num_frames; i++) {
+    int32_t sum = 0;
+    for (int channel = 0; channel < info->channels; channel++) {
+      sum += info->format == PCM_S16 ? (int16_t)read_u16(p) : read_s24(p);
+      p += bytes_per_sample;
+    }
+    int32_t x = sum / info->channels;
+    for (int byte = 0; byte < bytes_per_sample; byte++)
+      *out++ = (x >> (8*byte)) & 0xFF;
+  }
+}
+
+bool is_wav_zero_copy(const WavInfo *info, PcmFormat storage_format) {
+  int bytes_per_sample = info->bytes_per_frame / info->channels;
+  // Packed 24-bit samples are read a byte at a time, so need no alignment
+  int alignment = storage_format == PCM_S24 ? 1 : bytes_per_sample;
+  return info->format == storage_format && info->channels == 1 && (uintptr_t)info->pcm % alignment == 0;
+}
+
+static void put_u16(unsigned char *p, uint16_t x) {
+  p[0] = x & 0xFF;
+  p[1] = x >> 8;
+}
+
+static void put_u32(unsigned char *p, uint32_t x) {
+  for (int byte = 0; byte < 4; byte++)
+    p[byte] = (x >> (8*byte)) & 0xFF;
+}
+
+bool write_wav_file(const char *path, int sample_rate, PcmFormat format, const void *data, int num_frames) {
+  int bytes_per_frame = format == PCM_S16 ? 2 : 4;
+  uint32_t data_size = (uint32_t)num_frames * bytes_per_frame;
+  unsigned char header[44];
+  memcpy(header, "RIFF", 4);
+  put_u32(header + 4, 36 + data_size);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  put_u32(header + 16, 16);
+  put_u16(header + 20, format == PCM_S16 ? WAVE_FORMAT_PCM : WAVE_FORMAT_IEEE_FLOAT);
+  put_u16(header + 22, 1);
+  put_u32(header + 24, sample_rate);
+  put_u32(header + 28, sample_rate * bytes_per_frame);
+  put_u16(header + 32, bytes_per_frame);
+  put_u16(header + 34, 8 * bytes_per_frame);
+  memcpy(header + 36, "data", 4);
+  put_u32(header + 40, data_size);
+
+  // Several loader threads may write the same file at once, so each writes
+  // its own temporary file
+  char temp_path[1024];
+  if (snprintf(temp_path, sizeof(temp_path), "%s.%p.tmp", path, data) >= (int)sizeof(temp_path))
+    return false;
+  FILE *f = fopen(temp_path, "wb");
+  if (f == NULL)
+    return false;
+  // PCM is written as is, so this assumes a little-endian machine like the
+  // rest of the loading code does when mapping files
+  bool is_written = fwrite(header, sizeof(header), 1, f) == 1
+    && fwrite(data, bytes_per_frame, num_frames, f) == (size_t)num_frames;
+  is_written = fclose(f) == 0 && is_written;
+  is_written = is_written && replace_file(temp_path, path);
+  if (!is_written)
+    remove(temp_path);
+  return is_written;
+}
+
+void convert_s16_to_f32(const int16_t *in, int n, float *out) {
+  int i = 0;
+#ifdef __SSE2__
+  const __m128 scale = _mm_set1_ps(1 / 32768.0f);
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+    // Put each sample in the top half of a 32-bit lane, then shift it down
+    // with sign extension
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = in[i] / 32768.0f;
+}
+
+void convert_s24_to_f32(const unsigned char *in, int n, float *out) {
+  int i = 0;
+#ifdef __SSE2__
+  // SSE2 has no byte shuffles, so the samples are gathered into the top of
+  // 32-bit lanes by hand and only the conversion is vectorised
+  const __m128 scale = _mm_set1_ps(1 / 2147483648.0f);
+  for (; i + 4 <= n; i += 4) {
+    const unsigned char *p = in + 3*i;
+    __m128i x = _mm_set_epi32(
+      (int32_t)((uint32_t)p[9] << 8 | (uint32_t)p[10] << 16 | (uint32_t)p[11] << 24),
+      (int32_t)((uint32_t)p[6] << 8 | (uint32_t)p[7] << 16 | (uint32_t)p[8] << 24),
+      (int32_t)((uint32_t)p[3] << 8 | (uint32_t)p[4] << 16 | (uint32_t)p[5] << 24),
+      (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24));
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = read_s24(in + 3*i) / 8388608.0f;
+}
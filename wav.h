@@ -0,0 +1,86 @@
+#ifndef _WAV
+#define _WAV
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// NOTE: this module must not include raylib.h, as it includes windows.h on
+// Windows and the two don't get along.
+
+/** A read-only memory mapping of a whole file **/
+typedef struct {
+  const unsigned char *bytes;
+  size_t size;
+  void *handle;  // Only used on Windows
+} MappedFile;
+
+/** Enough to tell whether a file has changed since it was last loaded **/
+typedef struct {
+  long long size;
+  long long mtime;
+} FileStamp;
+
+bool get_file_stamp(const char *path, FileStamp *stamp);
+bool is_same_file_stamp(const FileStamp *a, const FileStamp *b);
+/* Absolute path with symlinks resolved, so that one file always has the same
+   path. Returns false if the file doesn't exist or the path doesn't fit. */
+bool get_canonical_path(const char *path, char *out, size_t size);
+
+bool map_file(const char *path, MappedFile *file);
+void unmap_file(MappedFile *file);
+/* Read up to size bytes from offset in f. Returns the number of bytes read,
+   which is short at the end of the file. Unlike a mapping, this is safe on a
+   file that may be truncated or rewritten while it is open. */
+size_t read_file_at(FILE *f, long long offset, void *out, size_t size);
+/* Creates a directory if it isn't there already */
+bool make_directory(const char *path);
+/* Renames from to to, replacing to if it exists */
+bool replace_file(const char *from, const char *to);
+/* 64-bit FNV-1a hash of size bytes, carrying on from hash (which should start
+   at FNV_OFFSET_BASIS) */
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t size);
+
+typedef enum {
+  PCM_U8, PCM_S16, PCM_S24, PCM_S32, PCM_F32, PCM_F64
+} PcmFormat;
+
+/** Where the PCM data of a .wav file is, and how to read it **/
+typedef struct {
+  int sample_rate;
+  int channels;
+  int num_frames;
+  PcmFormat format;
+  int bytes_per_frame;
+  const unsigned char *pcm;  // Points into the MappedFile the header was parsed from
+} WavInfo;
+
+/* Parse the header of a mapped .wav file. Returns false if the file isn't a
+   .wav file that we can read. */
+bool parse_wav_header(const MappedFile *file, WavInfo *info);
+/* Like parse_wav_header(), but reads the header from f with read_file_at(),
+   for files that may be cut short while they are read. info->pcm is left
+   NULL; the PCM data starts at *pcm_offset in the file. */
+bool read_wav_header(FILE *f, WavInfo *info, long long *pcm_offset);
+/* Decode num_frames frames starting from first_frame into out, mixing all
+   channels down to one. */
+void decode_wav_frames(const WavInfo *info, int first_frame, int num_frames, float *out);
+/* Like decode_wav_frames(), but keeps 16- and 24-bit PCM in its own format
+   (24-bit stays packed into 3 bytes). Only for PCM_S16 and PCM_S24. */
+void decode_wav_frames_native(const WavInfo *info, int first_frame, int num_frames, unsigned char *out);
+/* Returns true if the PCM data is already mono and in storage_format, so that
+   it can be used directly out of the mapping without decoding. */
+bool is_wav_zero_copy(const WavInfo *info, PcmFormat storage_format);
+
+/* Write mono PCM in format (PCM_S16 or PCM_F32) to a new .wav file at path.
+   The file is written under a temporary name and renamed into place, so that
+   a half written file is never read. */
+bool write_wav_file(const char *path, int sample_rate, PcmFormat format, const void *data, int num_frames);
+
+/* Block conversions of mono PCM to float, vectorised where SSE2 is available */
+void convert_s16_to_f32(const int16_t *in, int n, float *out);
+void convert_s24_to_f32(const unsigned char *in, int n, float *out);
+
+#endif